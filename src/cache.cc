@@ -4,10 +4,11 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "cache.h"
 using namespace std;
 
-Cache::Cache(int s, int a, int b)
+Cache::Cache(int s, int a, int b, bool sparse)
 {
    ulong i, j;
    reads = readMisses = writes = 0;
@@ -25,6 +26,33 @@ Cache::Cache(int s, int a, int b)
    //*******************//
    // initialize your counters here//
    //*******************//
+   memset(transitions, 0, sizeof(transitions));
+   memset(accessClasses, 0, sizeof(accessClasses));
+   classifier = NULL;
+   accessClass = ACCESS_HIT;
+   msgsAtAccess = lastLatency = 0;
+   atomics = scFailures = reservation = 0;
+   reservationValid = false;
+   lastBlock = 0;
+   lastLine = NULL;
+   sectors = 1;
+   log2Sector = log2Blk;
+   sectorsSpared = 0;
+   sampleScale = 1.0;
+   replacement = REPL_LRU;
+   role = ROLE_SUPPLIER;
+   randState = 0x2545F4914F6CDD1DUL;
+   redirectedToMem = 0;
+   readExclusives = updatesSent = updatesReceived = 0;
+   snoopProbes = busyCycles = 0;
+   victimLines = NULL;
+   victimEntries = victimHits = victimInserts = 0;
+   wbBuffer = NULL;
+   busClock = NULL;
+   logWritebacks = false;
+   updateFrom = INVALID;
+   for (i = 0; i < NUM_ACCESS_CLASSES; i++)
+      latencies[i] = NULL;
 
    tagMask = 0;
    for (i = 0; i < log2Sets; i++)
@@ -33,18 +61,78 @@ Cache::Cache(int s, int a, int b)
       tagMask |= 1;
    }
 
-   /**create a two dimentional cache, sized as cache[sets][assoc]**/
-   cache = new cacheLine *[sets];
-   for (i = 0; i < sets; i++)
+   sparseSets = NULL;
+   cache = NULL;
+   if (sparse)
    {
-      cache[i] = new cacheLine[assoc];
-      for (j = 0; j < assoc; j++)
+      /**sparse caches materialize their sets on first touch**/
+      sparseSets = new SetStore(assoc);
+   }
+   else
+   {
+      /**create a two dimentional cache, sized as cache[sets][assoc]**/
+      cache = new cacheLine *[sets];
+      for (i = 0; i < sets; i++)
       {
-         cache[i][j].invalidate();
+         cache[i] = new cacheLine[assoc];
+         for (j = 0; j < assoc; j++)
+         {
+            cache[i][j].invalidate();
+         }
       }
    }
 }
 
+Cache::~Cache()
+{
+   delete classifier;
+   for (int i = 0; i < NUM_ACCESS_CLASSES; i++)
+      delete latencies[i];
+   delete sparseSets;
+   delete[] victimLines;
+   delete wbBuffer;
+   delete cache;
+}
+
+void Cache::enableMissClassification()
+{
+   if (classifier == NULL)
+      classifier = new MissClassifier(numLines);
+}
+
+/*track validity and coherence state per sector, tags stay per line*/
+void Cache::enableSectors(ulong n)
+{
+   sectors = n;
+   log2Sector = log2Blk - (ulong)(log2(n));
+}
+
+/*evicted blocks move to a fully associative victim cache of n lines, they stay
+coherent there because findLine (and with it every snoop) searches it too*/
+void Cache::enableVictimCache(ulong n)
+{
+   victimEntries = n;
+   victimLines = new cacheLine[n];
+   for (ulong i = 0; i < n; i++)
+      victimLines[i].invalidate();
+}
+
+/*writebacks queue in a buffer of depth entries that drains against clock*/
+void Cache::enableWritebackBuffer(ulong depth, const ulong *clock)
+{
+   wbBuffer = new WritebackBuffer(depth);
+   busClock = clock;
+}
+
+/*timing reports latencies per access class, so it needs the classifier too*/
+void Cache::enableTiming()
+{
+   enableMissClassification();
+   for (int i = 0; i < NUM_ACCESS_CLASSES; i++)
+      if (latencies[i] == NULL)
+         latencies[i] = new LatencyHistogram();
+}
+
 /**you might add other parameters to Access()
 since this function is an entry point
 to the memory hierarchy (i.e. caches)**/
@@ -55,6 +143,24 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
    currentHit = 0;
    inc = 0;
 
+   if (op == OP_RMW || op == OP_ACQUIRE || op == OP_SC || op == OP_RELEASE)
+   {
+      if (op != OP_RELEASE)
+         atomics++;
+      op = 'w'; // Ownership is taken up front, an atomic's read never goes out as a GetS
+   }
+   else if (op == OP_LL)
+   {
+      reservation = calcTag(addr);
+      reservationValid = true;
+   }
+   uchar hint = op;
+   ulong sector = sectorOf(addr);
+   if (op == OP_READ_EXCLUSIVE)
+      op = 'r';
+   else if (op == OP_WRITE_UPDATE)
+      op = 'w';
+
    if (op == 'w')
    {
       writes++;
@@ -65,6 +171,110 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
    }
 
    cacheLine *line = findLine(addr);
+   if (victimLines != NULL && (line == NULL || (line >= victimLines && line < victimLines + victimEntries)))
+   {
+      cacheLine *victim = victimOf(calcTag(addr));
+      if (victim != NULL)
+         line = promoteVictim(victim, addr);
+   }
+   ulong oldState = (line == NULL) ? INVALID : line->getFlags(sector);
+   msgsAtAccess = getMMsgs + getSMsgs;
+   if (classifier != NULL)
+   {
+      if (line != NULL)
+         accessClass = ACCESS_HIT;
+      else if (sectors > 1 && blockLine(addr) != NULL)
+         accessClass = MISS_SECTOR; // The shadow cache tracks blocks, it has no say on sectors
+      else
+         accessClass = classifier->classify(calcTag(addr));
+      accessClasses[accessClass]++;
+      classifier->touch(calcTag(addr));
+   }
+   unsigned int busAction;
+   if (hint == OP_READ_EXCLUSIVE && line == NULL && protocol != 0 && protocol != 2)
+      busAction = exclusiveRead(line, addr, protocol); // MSI and MOSI have no clean exclusive state to read into
+   else if (hint == OP_WRITE_UPDATE && (line == NULL || oldState == VALID || oldState == OWNED))
+   {
+      updateFrom = oldState;
+      busAction = updateWrite(line, addr); // Only where the base protocol would send a GetM
+   }
+   else
+      busAction = processorAccess(line, addr, op, protocol);
+   lastBlock = calcTag(addr);
+   lastLine = line;
+   line->setSpared(false); // A line sized unit would have fetched the whole block again
+   if (busAction < POLL_MESI) // Read misses that poll and updates settle their final state in sendBusReaction
+   {
+      countTransition((op == 'w') ? PR_WRITE : PR_READ, oldState, line->getFlags(sector));
+   }
+   return busAction;
+}
+
+/*fast path for n back to back re-hits on the block of the previous access: read hits
+and write hits in M (or silent E->M) cannot change remote state, so the caller
+skips the snoop loop. Updates the same counters Access would, returns false
+when the access has to go through Access and the bus*/
+bool Cache::localHit(ulong addr, uchar op, uint protocol, ulong n)
+{
+   ulong block = calcTag(addr);
+   ulong sector = sectorOf(addr);
+   if (block != lastBlock || lastLine == NULL || !lastLine->anyValid() || lastLine->getTag() != block)
+      return false;
+   if (!lastLine->isValid(sector))
+      return false; // Sector miss in a present block
+   if (op == OP_READ_EXCLUSIVE)
+      op = 'r'; // Adaptive hints only matter when the access goes to the bus
+   else if (op == OP_WRITE_UPDATE)
+      op = 'w';
+   if (op != 'r' && op != 'w')
+      return false; // Atomics keep their own path
+
+   ulong state = lastLine->getFlags(sector);
+   if (op == 'w')
+   {
+      if (state == EXCLUSIVE && (protocol == 1 || protocol == 3))
+      {
+         silentUpgrade++; // Only the first write of a run upgrades
+         lastLine->setFlags(sector, DIRTY);
+         countTransition(PR_WRITE, EXCLUSIVE, DIRTY);
+         transitions[PR_WRITE][DIRTY][DIRTY] += n - 1;
+      }
+      else if (state == DIRTY)
+         transitions[PR_WRITE][DIRTY][DIRTY] += n;
+      else
+         return false;
+      writes += n;
+      writeHits += n;
+   }
+   else
+   {
+      transitions[PR_READ][state][state] += n;
+      reads += n;
+      readHits += n;
+   }
+
+   currentCycle += n;
+   updateLRU(lastLine);
+   lastLine->setSpared(false);
+   currentHit = 1;
+   inc = 0;
+   msgsAtAccess = getMMsgs + getSMsgs;
+   lastLatency = HIT_LATENCY;
+   busyCycles += HIT_LATENCY * n;
+   if (classifier != NULL)
+   {
+      accessClass = ACCESS_HIT; // The block is still the MRU line of the shadow cache
+      accessClasses[ACCESS_HIT] += n;
+   }
+   if (latencies[0] != NULL)
+      latencies[ACCESS_HIT]->record(HIT_LATENCY, n);
+   return true;
+}
+
+/*protocol specific handling of a processor request, line is replaced by the filled line on a miss*/
+unsigned int Cache::processorAccess(cacheLine *&line, ulong addr, uchar op, uint protocol)
+{
+   ulong sector = sectorOf(addr);
    if (line == NULL) /*miss*/
    {
       if (op == 'w')
@@ -78,12 +288,12 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
          readMisses++;
       }
 
-      cacheLine *newline = fillLine(addr);
+      line = fillLine(addr);
       if (protocol == 0)
       { // MSI
          if (op == 'w')
          {
-            newline->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -93,7 +303,7 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MESI
          if (op == 'w')
          {
-            newline->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -105,7 +315,7 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MOSI
          if (op == 'w')
          {
-            newline->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -115,7 +325,7 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MOESI
          if (op == 'w')
          {
-            newline->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -125,7 +335,7 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // COFEE
          if (op == 'w')
          {
-            newline->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -154,11 +364,11 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MSI
          if (op == 'w')
          {
-            if (line->getFlags() == VALID)
+            if (line->getFlags(sector) == VALID)
             {
                getMMsgs++; // Ownership message sent if in S state for MSI, can't be in I state here
             }
-            line->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -170,15 +380,15 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MESI
          if (op == 'w')
          {
-            if (line->getFlags() == VALID)
+            if (line->getFlags(sector) == VALID)
             {
                getMMsgs++; // Ownership message sent if in S state for MESI, can't be in I state here.. E->M is silent
             }
-            else if (line->getFlags() == EXCLUSIVE)
+            else if (line->getFlags(sector) == EXCLUSIVE)
             {
                silentUpgrade++;
             }
-            line->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -190,11 +400,11 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MOSI
          if (op == 'w')
          {
-            if (line->getFlags() == VALID || line->getFlags() == OWNED)
+            if (line->getFlags(sector) == VALID || line->getFlags(sector) == OWNED)
             {
                getMMsgs++; // Ownership message sent if in S/O state for MOSI, can't be in I state here..
             }
-            line->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -206,15 +416,15 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // MOESI
          if (op == 'w')
          {
-            if (line->getFlags() == VALID || line->getFlags() == OWNED)
+            if (line->getFlags(sector) == VALID || line->getFlags(sector) == OWNED)
             {
                getMMsgs++; // Ownership message sent if in S/O state for MOESI, can't be in I state here.. E->M is silent
             }
-            else if (line->getFlags() == EXCLUSIVE)
+            else if (line->getFlags(sector) == EXCLUSIVE)
             {
                silentUpgrade++;
             }
-            line->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -226,15 +436,15 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
       { // COFEE
          if (op == 'w')
          {
-            if (line->getFlags() == VALID || line->getFlags() == OWNED)
+            if (line->getFlags(sector) == VALID || line->getFlags(sector) == OWNED)
             {
                getMMsgs++; // Ownership message sent if in S/O state for MOESI, can't be in I state here.. E->M is silent
             }
-            else if (line->getFlags() == COFEE)
+            else if (line->getFlags(sector) == COFEE)
             {
                silentUpgrade++;
             }
-            line->setFlags(DIRTY);
+            line->setFlags(sector, DIRTY);
             return MODIFIED;
          }
          else
@@ -250,6 +460,83 @@ unsigned int Cache::Access(ulong addr, uchar op, uint protocol)
    }
 }
 
+/*clean exclusive state a migratory block is read into, one the following write can leave silently*/
+static ulong exclusiveState(uint protocol)
+{
+   if (protocol == 4)
+      return COFEE;
+   return EXCLUSIVE;
+}
+
+/*read miss of a predicted migratory block: one GetM fetches it and invalidates the
+other copies, so the write that follows needs no upgrade. The final state is settled
+in sendBusReaction, it stays dirty if a modified or owned copy handed the data over*/
+unsigned int Cache::exclusiveRead(cacheLine *&line, ulong addr, uint protocol)
+{
+   readMisses++;
+   getMMsgs++;
+   readExclusives++;
+   line = fillLine(addr);
+   return READ_EXCLUSIVE;
+}
+
+/*write of a predicted producer-consumer or read-mostly block that would need a GetM:
+an update goes out instead, its final state depends on the sharers left*/
+unsigned int Cache::updateWrite(cacheLine *&line, ulong addr)
+{
+   if (line == NULL)
+   {
+      writeMisses++;
+      line = fillLine(addr);
+   }
+   else
+   {
+      writeHits++;
+      currentHit = 1;
+      updateLRU(line);
+   }
+   updatesSent++;
+   return UPDATE;
+}
+
+/*store-conditional check, the reservation is consumed either way*/
+bool Cache::checkReservation(ulong addr)
+{
+   bool ok = reservationValid && reservation == calcTag(addr);
+   reservationValid = false;
+   if (!ok)
+      scFailures++;
+   return ok;
+}
+
+/*line holding some sector of addr's block, NULL if the block is absent*/
+cacheLine *Cache::blockLine(ulong addr)
+{
+   ulong i = calcIndex(addr);
+   cacheLine *set = (sparseSets == NULL) ? cache[i] : sparseSets->find(i);
+   if (set != NULL)
+   {
+      for (ulong j = 0; j < assoc; j++)
+         if (set[j].anyValid() && set[j].getTag() == calcTag(addr))
+            return &(set[j]);
+   }
+   return victimOf(calcTag(addr));
+}
+
+/*a snoop invalidated one sector of line, or a GetM hit a sector it lacks. A line
+sized coherence unit would have lost the whole block, so the sectors still valid
+count as spared. Only once until this core touches the block again: a line sized
+unit would not hold the block any more to lose it a second time*/
+void Cache::spareSectors(cacheLine *line)
+{
+   if (line->isSpared())
+      return;
+   for (ulong s = 0; s < sectors; s++)
+      if (line->isValid(s))
+         sectorsSpared++;
+   line->setSpared(true);
+}
+
 /*look up line*/
 cacheLine *Cache::findLine(ulong addr)
 {
@@ -258,24 +545,79 @@ cacheLine *Cache::findLine(ulong addr)
    pos = assoc;
    tag = calcTag(addr);
    i = calcIndex(addr);
-
-   for (j = 0; j < assoc; j++)
-      if (cache[i][j].isValid())
-         if (cache[i][j].getTag() == tag)
-         {
-            pos = j;
-            break;
-         }
+   cacheLine *set = (sparseSets == NULL) ? cache[i] : sparseSets->find(i);
+   if (set != NULL) // NULL for a never touched set of a sparse cache
+   {
+      for (j = 0; j < assoc; j++)
+         if (set[j].anyValid())
+            if (set[j].getTag() == tag)
+            {
+               pos = j;
+               break;
+            }
+   }
    if (pos == assoc)
-      return NULL;
+   {
+      cacheLine *victim = victimOf(tag);
+      if (victim == NULL)
+         return NULL;
+      return victim->isValid(sectorOf(addr)) ? victim : NULL;
+   }
+   if (!set[pos].isValid(sectorOf(addr)))
+      return NULL; // Sectored line holds the tag but not this sector
+   return &(set[pos]);
+}
+
+/*victim cache line holding block tag, NULL if there is none or no victim cache*/
+cacheLine *Cache::victimOf(ulong tag)
+{
+   for (ulong j = 0; j < victimEntries; j++)
+      if (victimLines[j].anyValid() && victimLines[j].getTag() == tag)
+         return &(victimLines[j]);
+   return NULL;
+}
+
+/*victim cache hit: the block swaps places with the line its set would replace,
+keeping its coherence state. Returns the line of addr, NULL on a sector miss*/
+cacheLine *Cache::promoteVictim(cacheLine *victim, ulong addr)
+{
+   cacheLine *slot = getLRU(addr);
+   cacheLine displaced = *slot;
+   *slot = *victim;
+   slot->setSeq(currentCycle);
+   if (displaced.anyValid())
+   {
+      *victim = displaced;
+      victim->setSeq(currentCycle);
+      victimInserts++;
+   }
    else
-      return &(cache[i][pos]);
+      victim->invalidate();
+   cacheLine *line = findLine(addr);
+   if (line != NULL)
+      victimHits++;
+   return line;
+}
+
+/*a block leaves the cache: count its sectors' evictions and write the dirty ones back*/
+void Cache::evictLine(cacheLine *line)
+{
+   if (reservationValid && reservation == line->getTag())
+      reservationValid = false;
+   for (ulong s = 0; s < sectors; s++)
+   {
+      if (line->isValid(s))
+         countTransition(EVICT, line->getFlags(s), INVALID);
+      if (line->getFlags(s) == DIRTY)
+         writeBack(calcAddr4Tag(line->getTag()) + (s << log2Sector));
+   }
 }
 
 /*upgrade LRU line to be MRU line*/
 void Cache::updateLRU(cacheLine *line)
 {
-   line->setSeq(currentCycle);
+   if (replacement == REPL_LRU)
+      line->setSeq(currentCycle); // FIFO keeps the fill time, random ignores it
 }
 
 /*return an invalid line as LRU, if any, otherwise return LRU line*/
@@ -286,23 +628,39 @@ cacheLine *Cache::getLRU(ulong addr)
    victim = assoc;
    min = currentCycle;
    i = calcIndex(addr);
+   cacheLine *set = (sparseSets == NULL) ? cache[i] : sparseSets->touch(i);
 
+   if (sectors > 1)
+   {
+      for (j = 0; j < assoc; j++)
+      {
+         if (set[j].anyValid() && set[j].getTag() == calcTag(addr))
+            return &(set[j]); // Sector miss, the block already owns a line
+      }
+   }
    for (j = 0; j < assoc; j++)
    {
-      if (cache[i][j].isValid() == 0)
-         return &(cache[i][j]);
+      if (set[j].anyValid() == 0)
+         return &(set[j]);
+   }
+   if (replacement == REPL_RANDOM)
+   {
+      randState ^= randState << 13;
+      randState ^= randState >> 7;
+      randState ^= randState << 17;
+      return &(set[randState % assoc]);
    }
    for (j = 0; j < assoc; j++)
    {
-      if (cache[i][j].getSeq() <= min)
+      if (set[j].getSeq() <= min)
       {
          victim = j;
-         min = cache[i][j].getSeq();
+         min = set[j].getSeq();
       }
    }
    assert(victim != assoc);
 
-   return &(cache[i][victim]);
+   return &(set[victim]);
 }
 
 /*find a victim, move it to MRU position*/
@@ -321,12 +679,28 @@ cacheLine *Cache::fillLine(ulong addr)
 
    cacheLine *victim = findLineToReplace(addr);
    assert(victim != 0);
-   if (victim->getFlags() == DIRTY)
-      writeBack(addr);
-
    tag = calcTag(addr);
-   victim->setTag(tag);
-   victim->setFlags(VALID);
+   if (!victim->anyValid() || victim->getTag() != tag)
+   {
+      if (victim->anyValid() && victimLines != NULL)
+      {
+         cacheLine *slot = &(victimLines[0]); // Invalid entry or else the least recently inserted
+         for (ulong j = 0; j < victimEntries && slot->anyValid(); j++)
+            if (!victimLines[j].anyValid() || victimLines[j].getSeq() < slot->getSeq())
+               slot = &(victimLines[j]);
+         if (slot->anyValid())
+            evictLine(slot);
+         *slot = *victim;
+         slot->setSeq(currentCycle);
+         victimInserts++;
+      }
+      else if (victim->anyValid())
+         evictLine(victim);
+      victim->invalidate();
+      victim->setTag(tag);
+      victim->setSeq(currentCycle); // Fill time, the FIFO order
+   }
+   victim->setFlags(sectorOf(addr), VALID);
    /**note that this cache line has been already
       upgraded to MRU in the previous function (findLineToReplace)**/
 
@@ -335,20 +709,90 @@ cacheLine *Cache::fillLine(ulong addr)
 
 unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint &incServicedFromOtherCore, uint &incServicedFromMem)
 {
+   bool readExclusive = (busAction == READ_EXCLUSIVE);
+   if (readExclusive)
+      busAction = MODIFIED; // Returns 1 below if the only dirty copy was handed over
    cacheLine *line = findLine(addr);
+   if (line == NULL && sectors > 1 && busAction == MODIFIED)
+   {
+      cacheLine *block = blockLine(addr); // GetM to a sector this cache lacks, siblings stay valid
+      if (block != NULL)
+         spareSectors(block);
+   }
+   if (line == NULL || busAction == NOACTION)
+   {
+      return snoopLine(line, protocol, busAction, addr, incServicedFromOtherCore, incServicedFromMem);
+   }
+   ulong sector = sectorOf(addr);
+   ulong oldState = line->getFlags(sector);
+   uint suppliedBefore = incServicedFromOtherCore;
+   ulong writeBacksBefore = writeBacks;
+   unsigned int ret;
+   if (busAction == UPDATE)
+      ret = snoopUpdate(line, addr, incServicedFromOtherCore);
+   else
+      ret = snoopLine(line, protocol, busAction, addr, incServicedFromOtherCore, incServicedFromMem);
+   if (role == ROLE_MEMORY_SOURCED && incServicedFromOtherCore && !suppliedBefore)
+   {
+      incServicedFromOtherCore = 0;
+      incServicedFromMem = 1;
+      redirectedToMem++;
+      if ((oldState == DIRTY || oldState == OWNED) && writeBacks == writeBacksBefore)
+         writeBack(addr); // Memory has to be current before it can answer
+      if (line->getFlags(sector) == OWNED)
+         line->setFlags(sector, VALID); // Memory is the owner now
+   }
+   countTransition((busAction == MODIFIED) ? BUS_GETM : ((busAction == UPDATE) ? BUS_UPDATE : BUS_GETS), oldState, line->getFlags(sector));
+   if (!line->isValid(sector))
+   {
+      if (sectors > 1)
+         spareSectors(line);
+      if (classifier != NULL && !line->anyValid())
+         classifier->noteInvalidation(calcTag(addr)); // Only losing the whole block makes the next miss a coherence miss
+      if (reservationValid && reservation == calcTag(addr))
+         reservationValid = false; // Another core wrote the block, a pending SC must fail
+   }
+   if (readExclusive && (oldState == DIRTY || oldState == OWNED) && writeBacks == writeBacksBefore)
+      return 1; // Memory is stale, the requester has to keep the block dirty
+   return ret;
+}
+
+/*update of a remote write: the copy stays valid with the new data, an owner or
+exclusive holder supplies the block if the writer missed and drops to shared.
+Returns 1 while this cache still holds a copy*/
+unsigned int Cache::snoopUpdate(cacheLine *line, ulong addr, uint &incServicedFromOtherCore)
+{
+   ulong sector = sectorOf(addr);
+   if (line == NULL || !line->isValid(sector))
+      return 0;
+   if (line->getFlags(sector) != VALID)
+   {
+      incServicedFromOtherCore = 1;
+      line->setFlags(sector, VALID); // The writer becomes the owner
+   }
+   updatesReceived++;
+   if (reservationValid && reservation == calcTag(addr))
+      reservationValid = false; // The block was written, a pending SC must fail
+   return 1;
+}
+
+/*protocol specific reaction of this cache to a request seen on the bus, line is NULL if the block is not present*/
+unsigned int Cache::snoopLine(cacheLine *line, uint protocol, uint busAction, ulong addr, uint &incServicedFromOtherCore, uint &incServicedFromMem)
+{
+   ulong sector = sectorOf(addr);
    if (protocol == 0)
    { // MSI
       if (line != NULL)
       {
-         if (line->isValid())
+         if (line->isValid(sector))
          {
             if (busAction == SHARED)
             {
-               if (line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Sends data to memory other core on otherGetS in dirty state
                   writeBack(addr);              // Sends data to memory on otherGetS in dirty state
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
                else
                {
@@ -357,17 +801,17 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
             }
             else if (busAction == MODIFIED)
             {
-               if (line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM in dirty state
                   invalidations++;              // Updates whenever M -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                   // writeBack(addr); //No need to send data to memory if its a OtherGETM while you are in Dirty state
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   invalidations++; // Updates whenever S -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
             }
          }
@@ -377,22 +821,22 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
    { // MESI
       if (line != NULL)
       {
-         if (line->isValid())
+         if (line->isValid(sector))
          {
             if (busAction == MODIFIED)
             {
-               if (line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Send data to requester if in M state
                   // writeBack(addr); //No need to send data to memory if its a OtherGETM while you are in Dirty state
                   invalidations++; // Updates whenever M -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == EXCLUSIVE)
+               else if (line->getFlags(sector) == EXCLUSIVE)
                {
                   incServicedFromOtherCore = 1; // Send data to requester if in E state
                   invalidations++;              // Updates whenever E-> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
                else
                {
@@ -402,23 +846,23 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
                      incServicedFromMem = 1; // Serviced from memory if it was a miss
                   }
                   invalidations++; // Updates whenever S -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
             }
             else if (busAction == POLL_MESI)
             {
-               if (line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Send data to requester if in M state
                   writeBack(addr);              // need to send data to memory if its a OtherGETS while you are in Dirty state
                   invalidations++;              // Updates whenever M -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == EXCLUSIVE)
+               else if (line->getFlags(sector) == EXCLUSIVE)
                {
                   incServicedFromOtherCore = 1; // Send data to requester if in E state
                   sendDatatoMem++;
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
             }
          }
@@ -436,37 +880,37 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
    { // MOSI
       if (line != NULL)
       {
-         if (line->isValid())
+         if (line->isValid(sector))
          {
             if (busAction == MODIFIED)
             {
-               if (line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
                   // writeBack(addr); //Data not sent to memory if otherGetM done in DIrty state
                   invalidations++; // Updates whenever M -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == OWNED)
+               else if (line->getFlags(sector) == OWNED)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
                   invalidations++;              // Updates whenever O-> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   invalidations++; // Updates whenever S -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
             }
             else if (busAction == POLL_MOSI)
             {
-               if (line->getFlags() == OWNED || line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == OWNED || line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1;
-                  line->setFlags(OWNED); // Else leave state as is
+                  line->setFlags(sector, OWNED); // Else leave state as is
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   return 1;
                }
@@ -482,37 +926,37 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
    { // MOESI
       if (line != NULL)
       {
-         if (line->isValid())
+         if (line->isValid(sector))
          {
             if (busAction == MODIFIED)
             {
-               if (line->getFlags() == DIRTY || line->getFlags() == OWNED || line->getFlags() == EXCLUSIVE)
+               if (line->getFlags(sector) == DIRTY || line->getFlags(sector) == OWNED || line->getFlags(sector) == EXCLUSIVE)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
                   // writeBack(addr); //Data not sent to memory if otherGetM done in M/O/E state
                   invalidations++; // Updates whenever M/O/E -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   // servicedFromMem++; //Cant add here since a block in O state can also send data... /
                   invalidations++; // Updates whenever S -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
             }
             else if (busAction == POLL_MOESI)
             {
-               if (line->getFlags() == OWNED || line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == OWNED || line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
-                  line->setFlags(OWNED);        // Else leave state as is
+                  line->setFlags(sector, OWNED);        // Else leave state as is
                }
-               else if (line->getFlags() == EXCLUSIVE)
+               else if (line->getFlags(sector) == EXCLUSIVE)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   return 1;
                }
@@ -524,36 +968,36 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
    { // COFEE
       if (line != NULL)
       {
-         if (line->isValid())
+         if (line->isValid(sector))
          {
             if (busAction == MODIFIED)
             {
-               if (line->getFlags() == DIRTY || line->getFlags() == OWNED || line->getFlags() == COFEE)
+               if (line->getFlags(sector) == DIRTY || line->getFlags(sector) == OWNED || line->getFlags(sector) == COFEE)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
                   // writeBack(addr); //Data not sent to memory if otherGetM done in M/O/E state
                   invalidations++; // Updates whenever M/O/E -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   // servicedFromMem++; //Cant add here since a block in O state can also send data... /
                   invalidations++; // Updates whenever S -> I
-                  line->setFlags(INVALID);
+                  line->setFlags(sector, INVALID);
                }
             }
             else if (busAction == POLL_COFEE)
             {
-               if (line->getFlags() == OWNED || line->getFlags() == DIRTY)
+               if (line->getFlags(sector) == OWNED || line->getFlags(sector) == DIRTY)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
-                  line->setFlags(OWNED);        // Else leave state as is
+                  line->setFlags(sector, OWNED);        // Else leave state as is
                }
-               else if (line->getFlags() == COFEE)
+               else if (line->getFlags(sector) == COFEE)
                {
                   incServicedFromOtherCore = 1; // Sends data to other core on otherGetM state
                }
-               else if (line->getFlags() == VALID)
+               else if (line->getFlags(sector) == VALID)
                {
                   return 1;
                }
@@ -574,21 +1018,22 @@ unsigned int Cache::busResponse(uint protocol, uint busAction, ulong addr, uint
 void Cache::sendBusReaction(uint count, uint processors, ulong addr, uint protocol, uint busAction, uint &incServicedFromOtherCore, uint &incServicedFromMem)
 {
    cacheLine *line = findLine(addr);
+   ulong sector = sectorOf(addr);
    if (busAction == POLL_MESI)
    {
       if (line != NULL)
       {
          if (protocol == 1)
          { // MESI
-            if (line->isValid())
+            if (line->isValid(sector))
             {
                if (count != processors - 1)
                {
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
                else
                {
-                  line->setFlags(EXCLUSIVE);
+                  line->setFlags(sector, EXCLUSIVE);
                   incServicedFromMem = 1; // If it has reached here, it means all other blocks are in invalid state and memory sent this data
                }
             }
@@ -606,7 +1051,7 @@ void Cache::sendBusReaction(uint count, uint processors, ulong addr, uint protoc
             {
                incServicedFromMem = 1; // If it has reached here, it means all other blocks are in invalid/Shared state and memory sent this data
             }
-            line->setFlags(VALID);
+            line->setFlags(sector, VALID);
          }
       }
    }
@@ -616,16 +1061,16 @@ void Cache::sendBusReaction(uint count, uint processors, ulong addr, uint protoc
       {
          if (protocol == 3)
          { // MOESI
-            if (line->isValid())
+            if (line->isValid(sector))
             {
                if (count != processors - 1)
                {
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
                else
                {
                   incServicedFromMem = 1; // If it is set to exclusive then it is serviced from memory
-                  line->setFlags(EXCLUSIVE);
+                  line->setFlags(sector, EXCLUSIVE);
                }
             }
          }
@@ -637,52 +1082,115 @@ void Cache::sendBusReaction(uint count, uint processors, ulong addr, uint protoc
       {
          if (protocol == 4)
          { // COFEE
-            if (line->isValid())
+            if (line->isValid(sector))
             {
                if (count != processors - 1)
                {
-                  line->setFlags(VALID);
+                  line->setFlags(sector, VALID);
                }
                else
                {
                   incServicedFromMem = 1; // If it is set to exclusive then it is serviced from memory
-                  line->setFlags(COFEE);
+                  line->setFlags(sector, COFEE);
                }
             }
          }
       }
    }
+   else if (busAction == READ_EXCLUSIVE && line != NULL)
+   {
+      line->setFlags(sector, (count != 0) ? DIRTY : exclusiveState(protocol));
+      countTransition(PR_READ, INVALID, line->getFlags(sector)); // Completes the read miss started in Access
+   }
+   else if (busAction == UPDATE && line != NULL)
+   {
+      if (currentHit)
+         incServicedFromOtherCore = 0; // The writer had the data, an owner only handed over ownership
+      else if (!incServicedFromOtherCore)
+         incServicedFromMem = 1;
+      if (count == 0)
+         line->setFlags(sector, DIRTY); // No sharer left, same as the GetM of the base protocol
+      else if (protocol == 2 || protocol == 3 || protocol == 4)
+         line->setFlags(sector, OWNED); // Sharers hold the new data, memory does not
+      else
+      {
+         writeBack(addr); // No owned state, the update is written through to memory
+         line->setFlags(sector, VALID);
+      }
+      countTransition(PR_WRITE, updateFrom, line->getFlags(sector));
+   }
+   if (line != NULL && busAction >= POLL_MESI && busAction <= POLL_COFEE)
+   {
+      countTransition(PR_READ, INVALID, line->getFlags(sector)); // Completes the read miss started in Access
+   }
+}
+
+const char *stateName(ulong state)
+{
+   switch (state)
+   {
+   case INVALID:
+      return "I";
+   case VALID:
+      return "S";
+   case OWNED:
+      return "O";
+   case DIRTY:
+      return "M";
+   case EXCLUSIVE:
+      return "E";
+   case COFEE:
+      return "C";
+   }
+   return "?";
+}
+
+const char *eventName(uint event)
+{
+   switch (event)
+   {
+   case PR_READ:
+      return "PrRd";
+   case PR_WRITE:
+      return "PrWr";
+   case BUS_GETS:
+      return "GetS";
+   case BUS_GETM:
+      return "GetM";
+   case EVICT:
+      return "Evict";
+   case BUS_UPDATE:
+      return "Upd";
+   }
+   return "?";
+}
+
+/*states a protocol can legally hold a block in, used for transition coverage*/
+bool stateInProtocol(uint protocol, ulong state)
+{
+   switch (state)
+   {
+   case INVALID:
+   case VALID:
+   case DIRTY:
+      return true;
+   case EXCLUSIVE:
+      return (protocol == 1 || protocol == 3);
+   case OWNED:
+      return (protocol == 2 || protocol == 3 || protocol == 4);
+   case COFEE:
+      return (protocol == 4);
+   }
+   return false;
 }
 
 void Cache::printState(ulong addr, int cache_num)
 {
-   string state;
    cacheLine *line = findLine(addr);
 
    if (line != NULL)
    {
-      switch (line->getFlags())
-      {
-      case INVALID:
-         state = "I";
-         break;
-      case VALID:
-         state = "S";
-         break;
-      case OWNED:
-         state = "O";
-         break;
-      case DIRTY:
-         state = "M";
-         break;
-      case EXCLUSIVE:
-         state = "E";
-         break;
-      case COFEE:
-         state = "C";
-         break;
-      }
-      cout << "In cache " << cache_num << " Address: " << addr << " State: " << state << endl;
+      cout << "In cache " << cache_num << " Address: " << addr << " State: " << stateName(line->getFlags(sectorOf(addr))) << endl;
    }
    else
    {
@@ -694,26 +1202,53 @@ void Cache::updateStats(uint incServicedFromOtherCore, uint incServicedFromMem)
 {
    servicedFromMem += incServicedFromMem;
    servicedFromOtherCore += incServicedFromOtherCore;
+
+   lastLatency = HIT_LATENCY;
+   if (getMMsgs + getSMsgs != msgsAtAccess)
+      lastLatency += BUS_LATENCY;
+   if (!currentHit)
+      lastLatency += incServicedFromOtherCore ? C2C_LATENCY : MEM_LATENCY; // Nobody else held the block, memory sends it
+   busyCycles += lastLatency;
+   if (latencies[0] != NULL)
+      latencies[accessClass]->record(lastLatency);
 }
 
+/*counters in SAMPLE_* order, for the per set accounting of set sampling*/
+void Cache::getCounters(ulong *counters)
+{
+   counters[SAMPLE_READS] = reads;
+   counters[SAMPLE_WRITES] = writes;
+   counters[SAMPLE_READ_MISSES] = readMisses;
+   counters[SAMPLE_WRITE_MISSES] = writeMisses;
+   counters[SAMPLE_WRITEBACKS] = writeBacks;
+   counters[SAMPLE_INVALIDATIONS] = invalidations;
+   counters[SAMPLE_GETM] = getMMsgs;
+   counters[SAMPLE_GETS] = getSMsgs;
+   counters[SAMPLE_FROM_OTHER_CORE] = servicedFromOtherCore;
+   counters[SAMPLE_FROM_MEM] = servicedFromMem;
+}
+
+/*counts are extrapolated to all sets when only a sample of them was simulated*/
+#define SCALED(count) ((ulong)((count) * sampleScale + 0.5))
+
 void Cache::printStats(int proc_id)
 {
    printf("===== Simulation results      =====\n");
    /****print out the rest of statistics here.****/
    /****follow the ouput file format**************/
    printf("Processor number : %d\n", proc_id);
-   printf("01. number of reads:				%lu\n", reads);
-   printf("02a. number of read misses:			%lu\n", readMisses);
-   printf("02b. number of read Hits:        %lu\n", readHits);
-   printf("03. number of writes:				%lu\n", writes);
-   printf("04a. number of write misses:			%lu\n", writeMisses);
-   printf("04b. number of write Hits:       %lu\n", writeHits);
+   printf("01. number of reads:				%lu\n", SCALED(reads));
+   printf("02a. number of read misses:			%lu\n", SCALED(readMisses));
+   printf("02b. number of read Hits:        %lu\n", SCALED(readHits));
+   printf("03. number of writes:				%lu\n", SCALED(writes));
+   printf("04a. number of write misses:			%lu\n", SCALED(writeMisses));
+   printf("04b. number of write Hits:       %lu\n", SCALED(writeHits));
    printf("05. total miss rate:				%4.2f%%\n", ((double)(readMisses + writeMisses) / (double)(reads + writes)) * 100);
-   printf("06. number of writebacks:			%lu\n", writeBacks);
-   printf("07. number of invalidations:         %lu\n", invalidations);
-   printf("08. number of getMMsgs:         %lu\n", getMMsgs);
-   printf("09. number of servicedFromMem:         %lu\n", servicedFromMem);
-   printf("10. number of servicedFromOtherCore:         %lu\n", servicedFromOtherCore);
-   printf("10. number of sendDatatoMem:         %lu\n", sendDatatoMem);
-   printf("12. number of getSMsgs:         %lu\n", getSMsgs);
+   printf("06. number of writebacks:			%lu\n", SCALED(writeBacks));
+   printf("07. number of invalidations:         %lu\n", SCALED(invalidations));
+   printf("08. number of getMMsgs:         %lu\n", SCALED(getMMsgs));
+   printf("09. number of servicedFromMem:         %lu\n", SCALED(servicedFromMem));
+   printf("10. number of servicedFromOtherCore:         %lu\n", SCALED(servicedFromOtherCore));
+   printf("10. number of sendDatatoMem:         %lu\n", SCALED(getMemWrites()));
+   printf("12. number of getSMsgs:         %lu\n", SCALED(getSMsgs));
 }
@@ -7,6 +7,12 @@
 
 #include <cmath>
 #include <iostream>
+#include <vector>
+#include "histogram.h"
+#include "missclass.h"
+#include "setstore.h"
+#include "sampling.h"
+#include "wbbuffer.h"
 
 typedef unsigned long ulong;
 typedef unsigned char uchar;
@@ -30,9 +36,66 @@ enum
    POLL_MESI = 3,
    POLL_MOSI = 4,
    POLL_MOESI = 5,
-   POLL_COFEE = 6
+   POLL_COFEE = 6,
+   UPDATE = 7,        // Write update of the adaptive mode, sharers keep their copies
+   READ_EXCLUSIVE = 8 // GetM of an adaptive migratory read, snooped like MODIFIED
 };
 
+/****processor and bus events that index the state-transition matrix****/
+enum
+{
+   PR_READ = 0,
+   PR_WRITE,
+   BUS_GETS,
+   BUS_GETM,
+   EVICT,
+   BUS_UPDATE, // Only sent in the adaptive mode
+   NUM_EVENTS
+};
+#define NUM_STATES (COFEE + 1)
+
+/****replacement policies and coherence roles a core can be configured with****/
+enum
+{
+   REPL_LRU = 0,
+   REPL_FIFO,
+   REPL_RANDOM
+};
+enum
+{
+   ROLE_SUPPLIER = 0,  // Sends data to other cores like the protocol says
+   ROLE_MEMORY_SOURCED // Never sources data, dirty data is written back and memory answers
+};
+
+/****trace operations besides 'r' and 'w'****/
+#define OP_RMW 'a'     // Atomic read-modify-write, needs M even for its read
+#define OP_LL 'l'      // Load-linked, a read that sets the reservation
+#define OP_SC 's'      // Store-conditional, writes only if the reservation survived
+#define OP_ACQUIRE 'k' // Lock acquire, the test-and-set of a test-and-test-and-set lock
+#define OP_RELEASE 'u' // Lock release, a plain write of the lock
+
+/****hints the adaptive mode passes to Access in place of 'r' and 'w'****/
+#define OP_READ_EXCLUSIVE 'x' // Migratory block, a read miss takes it exclusive with one GetM
+#define OP_WRITE_UPDATE 'v'   // Producer-consumer or read-mostly block, a write updates the sharers
+
+/****latency model used with -timing, in cycles****/
+#define HIT_LATENCY 1
+#define BUS_LATENCY 10  // Added when the access puts a GetS/GetM on the bus
+#define C2C_LATENCY 20  // Added when another core supplies the data
+#define MEM_LATENCY 100 // Added when memory supplies the data
+
+const char *stateName(ulong);
+const char *eventName(uint);
+bool stateInProtocol(uint, ulong);
+
+/****a sectored line keeps a 4 bit state per sector in Flags, the state
+accessors take the sector they act on (always 0 without sectors)****/
+#define MAX_SECTORS 8
+#define SECTOR_BITS 4
+#define SECTOR_MASK 0xFUL
+#define STATE_BITS (MAX_SECTORS * SECTOR_BITS)
+#define LINE_SPARED (1UL << STATE_BITS) // Its surviving sectors were counted in sectorsSpared since the core last touched it
+
 class cacheLine
 {
 protected:
@@ -47,17 +110,24 @@ public:
       Flags = 0;
    }
    ulong getTag() { return tag; }
-   ulong getFlags() { return Flags; }
+   ulong getFlags(ulong sector) { return (Flags >> (sector * SECTOR_BITS)) & SECTOR_MASK; }
    ulong getSeq() { return seq; }
    void setSeq(ulong Seq) { seq = Seq; }
-   void setFlags(ulong flags) { Flags = flags; }
+   void setFlags(ulong sector, ulong flags)
+   {
+      ulong shift = sector * SECTOR_BITS;
+      Flags = (Flags & ~(SECTOR_MASK << shift)) | (flags << shift);
+   }
    void setTag(ulong a) { tag = a; }
    void invalidate()
    {
       tag = 0;
       Flags = INVALID;
    } // useful function
-   bool isValid() { return ((Flags) != INVALID); }
+   bool isValid(ulong sector) { return (getFlags(sector) != INVALID); }
+   bool anyValid() { return ((Flags & ((1UL << STATE_BITS) - 1)) != INVALID); } // Tag in use by some sector
+   bool isSpared() { return ((Flags & LINE_SPARED) != 0); }
+   void setSpared(bool spared) { Flags = spared ? (Flags | LINE_SPARED) : (Flags & ~LINE_SPARED); }
 };
 
 class Cache
@@ -72,17 +142,58 @@ protected:
    //******///
    // add coherence counters here///
    //******///
+   ulong transitions[NUM_EVENTS][NUM_STATES][NUM_STATES]; // [event][old state][new state]
+   void countTransition(uint event, ulong from, ulong to) { transitions[event][from][to]++; }
+   MissClassifier *classifier; // NULL unless miss classification is enabled
+   uint accessClass;           // Hit or miss class of the current access
+   ulong accessClasses[NUM_ACCESS_CLASSES];
+   LatencyHistogram *latencies[NUM_ACCESS_CLASSES]; // NULL unless timing is enabled
+   ulong msgsAtAccess;                              // getMMsgs + getSMsgs before the current access
+   ulong lastLatency;                               // Latency of the last access under the -timing model
+   ulong atomics, scFailures;
+   ulong reservation; // Block reserved by the last load-linked
+   bool reservationValid;
+   ulong lastBlock;     // Block of the last access, filters the local hit fast path
+   cacheLine *lastLine; // Line that access ended in
+   ulong sectors, log2Sector; // Coherence units per line and their size, 1 and log2Blk when not sectored
+   ulong sectorsSpared;       // Valid sectors that survived a snoop a line sized coherence unit would have been invalidated by
+   double sampleScale;        // Sets per simulated set when set sampling, scales printStats
+   uint replacement, role;
+   ulong randState;     // xorshift state for REPL_RANDOM
+   ulong redirectedToMem; // Snoops a memory sourced cache left to memory
+   ulong readExclusives, updatesSent, updatesReceived;
+   ulong snoopProbes; // GetS, GetM and updates of other caches this cache's tags were probed for
+   ulong busyCycles;  // Sum of access latencies under the -timing model
+   cacheLine *victimLines;      // Fully associative victim cache, NULL unless enabled
+   ulong victimEntries, victimHits, victimInserts;
+   WritebackBuffer *wbBuffer;   // NULL unless enabled
+   const ulong *busClock;       // Bus cycle of this set of caches the write-back buffer drains against
+   bool logWritebacks;          // Keep the address of every writeback for the message log
+   std::vector<ulong> writebackAddrs;
+   cacheLine *victimOf(ulong tag);
+   cacheLine *promoteVictim(cacheLine *, ulong);
+   void evictLine(cacheLine *);
+   ulong updateFrom; // State the line of a write update started in, its transition is counted in sendBusReaction
+   unsigned int exclusiveRead(cacheLine *&, ulong, uint);
+   unsigned int updateWrite(cacheLine *&, ulong);
+   unsigned int snoopUpdate(cacheLine *, ulong, uint &);
+   ulong sectorOf(ulong addr) { return ((addr >> log2Sector) & (sectors - 1)); }
+   cacheLine *blockLine(ulong);
+   void spareSectors(cacheLine *);
 
    cacheLine **cache;
+   SetStore *sparseSets; // Replaces cache when sets are materialized lazily
    ulong calcTag(ulong addr) { return (addr >> (log2Blk)); }
    ulong calcIndex(ulong addr) { return ((addr >> log2Blk) & tagMask); }
    ulong calcAddr4Tag(ulong tag) { return (tag << (log2Blk)); }
+   unsigned int processorAccess(cacheLine *&, ulong, uchar, uint);
+   unsigned int snoopLine(cacheLine *, uint, uint, ulong, uint &, uint &);
 
 public:
    ulong currentCycle;
 
-   Cache(int, int, int);
-   ~Cache() { delete cache; }
+   Cache(int, int, int, bool sparse = false);
+   ~Cache();
 
    cacheLine *findLineToReplace(ulong addr);
    cacheLine *fillLine(ulong addr);
@@ -94,13 +205,64 @@ public:
    ulong getReads() { return reads; }
    ulong getWrites() { return writes; }
    ulong getWB() { return writeBacks; }
+   ulong getTransitions(uint event, ulong from, ulong to) { return transitions[event][from][to]; }
+   ulong getAccessClass(uint c) { return accessClasses[c]; }
+   ulong getSets() { return sets; }
+   ulong getBlock(ulong addr) { return calcTag(addr); }
+   ulong getLastLatency() { return lastLatency; }
+   ulong getAtomics() { return atomics; }
+   ulong getSCFailures() { return scFailures; }
+   bool checkReservation(ulong);
+   SetStore *getSparseSets() { return sparseSets; }
+   LatencyHistogram *getLatency(uint c) { return latencies[c]; }
+   void enableMissClassification();
+   void enableTiming();
+   void enableSectors(ulong);
+   void setSampleScale(double scale) { sampleScale = scale; }
+   void setReplacement(uint r) { replacement = r; }
+   void setRole(uint r) { role = r; }
+   ulong getRedirectedToMem() { return redirectedToMem; }
+   ulong getSMsgsSent() { return getSMsgs; }
+   ulong getReadExclusives() { return readExclusives; }
+   ulong getUpdatesSent() { return updatesSent; }
+   ulong getUpdatesReceived() { return updatesReceived; }
+   ulong getSnoopProbes() { return snoopProbes; }
+   void noteSnoopProbe() { snoopProbes++; }
+   ulong getBusyCycles() { return busyCycles; }
+   ulong getMemWrites() { return sendDatatoMem + ((wbBuffer != NULL) ? wbBuffer->written : 0); } // Buffered writebacks count once memory takes them
+   ulong getSize() { return size; }
+   ulong getAssoc() { return assoc; }
+   ulong getVictimHits() { return victimHits; }
+   ulong getVictimInserts() { return victimInserts; }
+   WritebackBuffer *getWritebackBuffer() { return wbBuffer; }
+   bool lastAccessHit() { return currentHit; }
+   bool bufferSupplies(ulong addr) { return wbBuffer != NULL && wbBuffer->supply(addr >> log2Sector, *busClock); }
+   void enableVictimCache(ulong);
+   void enableWritebackLog() { logWritebacks = true; }
+   std::vector<ulong> &getWritebackAddrs() { return writebackAddrs; }
+   void enableWritebackBuffer(ulong, const ulong *);
+   void getCounters(ulong *);
+   ulong getSectorSize() { return (1UL << log2Sector); }
+   ulong getLineSize() { return lineSize; }
+   ulong getSectorsSpared() { return sectorsSpared; }
 
-   void writeBack(ulong)
+   void writeBack(ulong addr)
    {
       writeBacks++;
-      sendDatatoMem++;
+      if (wbBuffer == NULL)
+      {
+         sendDatatoMem++;
+         if (logWritebacks)
+            writebackAddrs.push_back(addr & ~(getSectorSize() - 1));
+         return;
+      }
+      ulong coalesced = wbBuffer->coalesced;
+      busyCycles += wbBuffer->push(addr >> log2Sector, *busClock); // A full buffer holds up the cache, every dirty sector is its own entry
+      if (logWritebacks && wbBuffer->coalesced == coalesced)
+         writebackAddrs.push_back(addr & ~(getSectorSize() - 1)); // A coalesced writeback sends nothing new to memory
    }
    unsigned int Access(ulong, uchar, uint);
+   bool localHit(ulong, uchar, uint, ulong);
    void printStats(int);
    void updateLRU(cacheLine *);
    unsigned int busResponse(uint, uint, ulong, uint &, uint &);
@@ -0,0 +1,110 @@
+/*******************************************************
+                          coreconfig.cc
+********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "coreconfig.h"
+
+const char *replacementName(uint replacement)
+{
+   switch (replacement)
+   {
+   case REPL_LRU:
+      return "lru";
+   case REPL_FIFO:
+      return "fifo";
+   case REPL_RANDOM:
+      return "random";
+   }
+   return "?";
+}
+
+const char *roleName(uint role)
+{
+   switch (role)
+   {
+   case ROLE_SUPPLIER:
+      return "supplier";
+   case ROLE_MEMORY_SOURCED:
+      return "memory";
+   }
+   return "?";
+}
+
+/*lines of "<proc>[-<last proc>] <size> <assoc> [lru|fifo|random] [supplier|memory]",
+'#' starts a comment. configs comes in holding the command line geometry for every
+core and only the listed cores are overridden. Returns false on a malformed file*/
+bool loadCoreConfigs(const char *fname, std::vector<CoreConfig> &configs)
+{
+   FILE *cFile = fopen(fname, "r");
+   if (cFile == 0)
+   {
+      printf("Config file problem\n");
+      return false;
+   }
+
+   char buf[256];
+   int lineNo = 0;
+   bool ok = true;
+   while (ok && fgets(buf, sizeof(buf), cFile) != NULL)
+   {
+      lineNo++;
+      char *comment = strchr(buf, '#');
+      if (comment != NULL)
+         *comment = '\0';
+
+      char procs[32], repl[16] = "lru", role[16] = "supplier";
+      int size, assoc, first, last;
+      int fields = sscanf(buf, "%31s %d %d %15s %15s", procs, &size, &assoc, repl, role);
+      if (fields <= 0)
+         continue; // Blank line
+      if (fields < 3 || size <= 0 || assoc <= 0)
+      {
+         printf("Config line %d: expected <proc> <size> <assoc> [replacement] [role]\n", lineNo);
+         ok = false;
+         break;
+      }
+      if (sscanf(procs, "%d-%d", &first, &last) != 2)
+         last = first = atoi(procs);
+
+      CoreConfig config;
+      config.size = size;
+      config.assoc = assoc;
+      if (!strcmp(repl, "lru"))
+         config.replacement = REPL_LRU;
+      else if (!strcmp(repl, "fifo"))
+         config.replacement = REPL_FIFO;
+      else if (!strcmp(repl, "random"))
+         config.replacement = REPL_RANDOM;
+      else
+      {
+         printf("Config line %d: unknown replacement %s\n", lineNo, repl);
+         ok = false;
+         break;
+      }
+      if (!strcmp(role, "supplier"))
+         config.role = ROLE_SUPPLIER;
+      else if (!strcmp(role, "memory"))
+         config.role = ROLE_MEMORY_SOURCED;
+      else
+      {
+         printf("Config line %d: unknown role %s\n", lineNo, role);
+         ok = false;
+         break;
+      }
+
+      if (first < 0 || last >= (int)configs.size() || first > last)
+      {
+         printf("Config line %d: processor %s out of range\n", lineNo, procs);
+         ok = false;
+         break;
+      }
+      for (int p = first; p <= last; p++)
+         configs[p] = config;
+   }
+   fclose(cFile);
+   return ok;
+}
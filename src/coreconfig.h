@@ -0,0 +1,25 @@
+/*******************************************************
+                          coreconfig.h
+********************************************************/
+
+#ifndef CORECONFIG_H
+#define CORECONFIG_H
+
+#include <vector>
+
+typedef unsigned int uint;
+
+/*private cache settings of one core. The block size is not part of it: it
+is the coherence granularity and stays the one given on the command line*/
+struct CoreConfig
+{
+   int size, assoc;
+   uint replacement; // REPL_*
+   uint role;        // ROLE_*
+};
+
+bool loadCoreConfigs(const char *fname, std::vector<CoreConfig> &configs);
+const char *replacementName(uint);
+const char *roleName(uint);
+
+#endif
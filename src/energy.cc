@@ -0,0 +1,147 @@
+/*******************************************************
+                          energy.cc
+********************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "energy.h"
+
+const char *energyPartName(uint part)
+{
+   switch (part)
+   {
+   case ENERGY_TAG:
+      return "tag lookups";
+   case ENERGY_DATA:
+      return "data array";
+   case ENERGY_SNOOP:
+      return "snoop probes";
+   case ENERGY_BUS:
+      return "bus requests";
+   case ENERGY_TRANSFER:
+      return "bus transfers";
+   case ENERGY_MEMORY:
+      return "memory";
+   case ENERGY_LEAKAGE:
+      return "leakage";
+   }
+   return "?";
+}
+
+void defaultEnergyParams(EnergyParams &params)
+{
+   params.tagPerWay = 0.8;
+   params.dataRead = 12.0;
+   params.dataWrite = 14.0;
+   params.snoopProbe = 1.5;
+   params.busMessage = 20.0;
+   params.transferPerByte = 1.2;
+   params.memoryPerByte = 80.0;
+   params.leakagePerKBCycle = 0.15;
+}
+
+/*lines of "<name> <pJ>" overriding the defaults, '#' starts a comment.
+Returns false on a malformed file*/
+bool loadEnergyParams(const char *fname, EnergyParams &params)
+{
+   FILE *eFile = fopen(fname, "r");
+   if (eFile == 0)
+   {
+      printf("Energy file problem\n");
+      return false;
+   }
+
+   struct
+   {
+      const char *name;
+      double *value;
+   } keys[] = {{"tag_per_way", &params.tagPerWay},
+               {"data_read", &params.dataRead},
+               {"data_write", &params.dataWrite},
+               {"snoop_probe", &params.snoopProbe},
+               {"bus_message", &params.busMessage},
+               {"transfer_per_byte", &params.transferPerByte},
+               {"memory_per_byte", &params.memoryPerByte},
+               {"leakage_per_kb_cycle", &params.leakagePerKBCycle}};
+   const int numKeys = sizeof(keys) / sizeof(keys[0]);
+
+   char buf[256];
+   int lineNo = 0;
+   bool ok = true;
+   while (ok && fgets(buf, sizeof(buf), eFile) != NULL)
+   {
+      lineNo++;
+      char *comment = strchr(buf, '#');
+      if (comment != NULL)
+         *comment = '\0';
+
+      char name[64];
+      double value;
+      int fields = sscanf(buf, "%63s %lf", name, &value);
+      if (fields <= 0)
+         continue; // Blank line
+      int k;
+      for (k = 0; k < numKeys; k++)
+         if (!strcmp(name, keys[k].name))
+            break;
+      if (fields < 2 || k == numKeys || value < 0)
+      {
+         printf("Energy line %d: expected <name> <pJ> with a known name\n", lineNo);
+         ok = false;
+         break;
+      }
+      *keys[k].value = value;
+   }
+   fclose(eFile);
+   return ok;
+}
+
+EnergyModel::EnergyModel(const EnergyParams &p)
+{
+   params = p;
+   memset(parts, 0, sizeof(parts));
+}
+
+/*adds one cache, returns its energy in pJ*/
+double EnergyModel::add(const CacheActivity &a)
+{
+   double e[NUM_ENERGY_PARTS];
+   e[ENERGY_TAG] = a.lookups * a.assoc * params.tagPerWay;
+   e[ENERGY_DATA] = a.dataReads * params.dataRead + a.dataWrites * params.dataWrite;
+   e[ENERGY_SNOOP] = a.snoops * (params.snoopProbe + a.assoc * params.tagPerWay);
+   e[ENERGY_BUS] = a.messages * params.busMessage;
+   e[ENERGY_TRANSFER] = a.bytes * params.transferPerByte;
+   e[ENERGY_MEMORY] = a.memoryBytes * params.memoryPerByte;
+   e[ENERGY_LEAKAGE] = (a.sizeBytes / 1024.0) * a.cycles * params.leakagePerKBCycle;
+
+   double sum = 0;
+   for (uint p = 0; p < NUM_ENERGY_PARTS; p++)
+   {
+      parts[p] += e[p];
+      sum += e[p];
+   }
+   return sum;
+}
+
+/*extrapolates a set sampled run to all sets*/
+void EnergyModel::scale(double factor)
+{
+   for (uint p = 0; p < NUM_ENERGY_PARTS; p++)
+      parts[p] *= factor;
+}
+
+double EnergyModel::total()
+{
+   double sum = 0;
+   for (uint p = 0; p < NUM_ENERGY_PARTS; p++)
+      sum += parts[p];
+   return sum;
+}
+
+void EnergyModel::print(const char *label)
+{
+   double sum = total();
+   printf("%s total: %.3f nJ\n", label, sum / 1000.0);
+   for (uint p = 0; p < NUM_ENERGY_PARTS; p++)
+      printf("  %-14s %12.3f nJ  %5.1f%%\n", energyPartName(p), parts[p] / 1000.0, (sum > 0) ? parts[p] * 100.0 / sum : 0.0);
+}
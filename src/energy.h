@@ -0,0 +1,72 @@
+/*******************************************************
+                          energy.h
+********************************************************/
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+typedef unsigned long ulong;
+typedef unsigned int uint;
+
+/****per event energies in pJ, defaults are for a 45nm private L1 on a snooping bus****/
+struct EnergyParams
+{
+   double tagPerWay;         // One way of a tag lookup, a lookup reads assoc ways
+   double dataRead;          // Data array read of one block (or sector)
+   double dataWrite;         // Data array write of one block (or sector)
+   double snoopProbe;        // Snoop controller work per busResponse probe, on top of its tag lookup
+   double busMessage;        // Arbitration and address broadcast of one bus request
+   double transferPerByte;   // Data moved over the bus
+   double memoryPerByte;     // DRAM read or write
+   double leakagePerKBCycle; // Static energy of one KB of cache for one cycle
+};
+
+/****parts the energy of a run is reported in****/
+enum
+{
+   ENERGY_TAG = 0,
+   ENERGY_DATA,
+   ENERGY_SNOOP,
+   ENERGY_BUS,
+   ENERGY_TRANSFER,
+   ENERGY_MEMORY,
+   ENERGY_LEAKAGE,
+   NUM_ENERGY_PARTS
+};
+
+/*events of one cache over the run, the caller derives them from its counters*/
+struct CacheActivity
+{
+   ulong assoc, sizeBytes;
+   ulong lookups;      // Processor accesses, each reads every tag way of a set
+   ulong snoops;       // busResponse probes that had to check the tags
+   ulong dataReads, dataWrites;
+   ulong messages;     // GetS, GetM, updates and writebacks put on the bus
+   ulong bytes;        // Data moved over the bus
+   ulong memoryBytes;  // Data read from or written to memory
+   ulong cycles;       // Time the cache leaks over
+};
+
+void defaultEnergyParams(EnergyParams &params);
+bool loadEnergyParams(const char *fname, EnergyParams &params);
+
+/*sums the energy of the caches of one run. Dynamic energy is events times the
+per event energy, leakage is size times cycles*/
+class EnergyModel
+{
+protected:
+   EnergyParams params;
+   double parts[NUM_ENERGY_PARTS]; // pJ
+
+public:
+   EnergyModel(const EnergyParams &p);
+
+   double add(const CacheActivity &activity);
+   void scale(double factor);
+   double total();
+   void print(const char *label);
+};
+
+const char *energyPartName(uint);
+
+#endif
@@ -0,0 +1,95 @@
+/*******************************************************
+                          histogram.cc
+********************************************************/
+
+#include <string.h>
+#include "histogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+   memset(buckets, 0, sizeof(buckets));
+   count = total = max = 0;
+   min = ~0UL;
+}
+
+/*magnitude 0 holds the exact values 0..2^SUB_BITS-1, magnitude m > 0 holds
+[2^(m+SUB_BITS-1), 2^(m+SUB_BITS)) split in 2^SUB_BITS equal buckets*/
+void LatencyHistogram::bucketOf(ulong value, ulong &magnitude, ulong &sub)
+{
+   if (value < HIST_SUB_BUCKETS)
+   {
+      magnitude = 0;
+      sub = value;
+      return;
+   }
+   ulong msb = 63 - __builtin_clzl(value);
+   magnitude = msb - HIST_SUB_BITS + 1;
+   sub = (value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+}
+
+/*lowest value that falls in a bucket*/
+ulong LatencyHistogram::valueOf(ulong magnitude, ulong sub)
+{
+   if (magnitude == 0)
+      return sub;
+   return (HIST_SUB_BUCKETS | sub) << (magnitude - 1);
+}
+
+void LatencyHistogram::record(ulong value, ulong times)
+{
+   ulong magnitude, sub;
+   bucketOf(value, magnitude, sub);
+   buckets[magnitude][sub] += times;
+   count += times;
+   total += value * times;
+   if (value < min)
+      min = value;
+   if (value > max)
+      max = value;
+}
+
+void LatencyHistogram::merge(LatencyHistogram *other)
+{
+   for (ulong m = 0; m < HIST_MAGNITUDES; m++)
+      for (ulong s = 0; s < HIST_SUB_BUCKETS; s++)
+         buckets[m][s] += other->buckets[m][s];
+   count += other->count;
+   total += other->total;
+   if (other->min < min)
+      min = other->min;
+   if (other->max > max)
+      max = other->max;
+}
+
+/*value at or below which p percent of the recorded values lie*/
+ulong LatencyHistogram::percentile(double p)
+{
+   if (count == 0)
+      return 0;
+   ulong rank = (ulong)((p / 100.0) * count + 0.5);
+   if (rank == 0)
+      rank = 1;
+   ulong seen = 0;
+   for (ulong m = 0; m < HIST_MAGNITUDES; m++)
+      for (ulong s = 0; s < HIST_SUB_BUCKETS; s++)
+      {
+         seen += buckets[m][s];
+         if (seen >= rank)
+         {
+            ulong value = valueOf(m, s);
+            return (value < min) ? min : ((value > max) ? max : value);
+         }
+      }
+   return max;
+}
+
+void LatencyHistogram::print(const char *name)
+{
+   if (count == 0)
+   {
+      printf("%-12s count: 0\n", name);
+      return;
+   }
+   printf("%-12s count: %lu  mean: %.2f  min: %lu  p50: %lu  p90: %lu  p99: %lu  max: %lu\n", name, count,
+          (double)total / (double)count, min, percentile(50), percentile(90), percentile(99), max);
+}
@@ -0,0 +1,38 @@
+/*******************************************************
+                          histogram.h
+********************************************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+
+typedef unsigned long ulong;
+
+/*HDR style log-linear histogram: values below 2^SUB_BITS are counted exactly,
+larger values fall in one of 2^SUB_BITS buckets per power of two, so the
+relative error of any reported value stays below 2^-SUB_BITS*/
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1UL << HIST_SUB_BITS)
+#define HIST_MAGNITUDES (64 - HIST_SUB_BITS + 1)
+
+class LatencyHistogram
+{
+protected:
+   ulong buckets[HIST_MAGNITUDES][HIST_SUB_BUCKETS];
+   ulong count, total, min, max;
+
+   void bucketOf(ulong value, ulong &magnitude, ulong &sub);
+   ulong valueOf(ulong magnitude, ulong sub);
+
+public:
+   LatencyHistogram();
+
+   void record(ulong value, ulong times = 1);
+   void merge(LatencyHistogram *other);
+   ulong getCount() { return count; }
+   ulong percentile(double p);
+   void print(const char *name);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*******************************************************
+                          locks.cc
+********************************************************/
+
+#include <stdio.h>
+#include "locks.h"
+
+LockTracker::LockTracker(int processors)
+{
+   waitingSince.resize(processors, 0);
+}
+
+LockStats &LockTracker::statsOf(ulong addr)
+{
+   std::map<ulong, LockStats>::iterator it = locks.find(addr);
+   if (it != locks.end())
+      return it->second;
+   LockStats &stats = locks[addr];
+   stats.owner = stats.lastOwner = NO_OWNER;
+   stats.acquires = stats.atomics = stats.handoffs = stats.spins = stats.contended = stats.totalWait = stats.maxWait = 0;
+   stats.waitedAcquires = 0;
+   return stats;
+}
+
+/*an atomic (RMW, successful SC or lock acquire) took the block in M state*/
+void LockTracker::noteAtomic(ulong addr, int proc)
+{
+   LockStats &stats = statsOf(addr);
+   stats.atomics++;
+   if (stats.lastOwner != NO_OWNER && stats.lastOwner != proc)
+      stats.handoffs++; // Ownership ping-pong between cores
+   stats.lastOwner = proc;
+}
+
+/*test-and-test-and-set: returns true if proc now holds the lock, otherwise proc spins on it*/
+bool LockTracker::tryAcquire(ulong addr, int proc, ulong now)
+{
+   LockStats &stats = statsOf(addr);
+   if (stats.owner == proc)
+      return true; // Already the holder, not a new acquisition
+   if (stats.owner == NO_OWNER)
+   {
+      bool waited = false;
+      for (std::deque<int>::iterator it = stats.waiters.begin(); it != stats.waiters.end(); ++it)
+      {
+         if (*it == proc)
+         {
+            stats.waiters.erase(it);
+            waited = true;
+            break;
+         }
+      }
+      ulong wait = waited ? now - waitingSince[proc] : 0;
+      stats.owner = proc;
+      stats.acquires++;
+      if (waited)
+         stats.waitedAcquires++;
+      stats.totalWait += wait;
+      if (wait > stats.maxWait)
+         stats.maxWait = wait;
+      return true;
+   }
+
+   stats.spins++;
+   for (std::deque<int>::iterator it = stats.waiters.begin(); it != stats.waiters.end(); ++it)
+   {
+      if (*it == proc)
+         return false; // Already spinning
+   }
+   stats.contended++;
+   stats.waiters.push_back(proc);
+   waitingSince[proc] = now;
+   return false;
+}
+
+/*returns true if the lock was held by proc and is now free*/
+bool LockTracker::release(ulong addr, int proc)
+{
+   LockStats &stats = statsOf(addr);
+   if (stats.owner != proc)
+      return false;
+   stats.owner = NO_OWNER;
+   return true;
+}
+
+/*hand a free lock to the oldest spinning core, returns it or NO_OWNER*/
+int LockTracker::grant(ulong addr, ulong now)
+{
+   LockStats &stats = statsOf(addr);
+   if (stats.waiters.empty() || stats.owner != NO_OWNER)
+      return NO_OWNER;
+   int next = stats.waiters.front();
+   tryAcquire(addr, next, now);
+   return next;
+}
+
+void LockTracker::print()
+{
+   printf("===== Atomics and locks =====\n");
+   for (std::map<ulong, LockStats>::iterator it = locks.begin(); it != locks.end(); ++it)
+   {
+      LockStats &stats = it->second;
+      printf("Address: %lx  atomics: %lu  ownership handoffs: %lu\n", it->first, stats.atomics, stats.handoffs);
+      if (stats.acquires == 0 && stats.spins == 0)
+         continue;
+      printf("  acquires: %lu  contended: %lu  failed spins: %lu  contended time-to-acquire mean: %.2f max: %lu accesses\n", stats.acquires,
+             stats.contended, stats.spins, (stats.waitedAcquires != 0) ? (double)stats.totalWait / (double)stats.waitedAcquires : 0.0, stats.maxWait);
+   }
+}
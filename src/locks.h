@@ -0,0 +1,47 @@
+/*******************************************************
+                          locks.h
+********************************************************/
+
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <deque>
+#include <map>
+#include <vector>
+
+typedef unsigned long ulong;
+
+#define NO_OWNER (-1)
+
+struct LockStats
+{
+   int owner;     // Core holding the lock, NO_OWNER when free
+   int lastOwner; // Last core that took the block with an atomic, for ping-pong
+   ulong acquires, atomics, handoffs, spins, contended, totalWait, maxWait;
+   ulong waitedAcquires; // Acquires that had to spin first, totalWait is over these
+   std::deque<int> waiters; // Spinning cores in arrival order
+};
+
+/*per address bookkeeping of atomics and locks. Time is logical: the number of
+trace accesses processed when an acquire is issued and when it succeeds*/
+class LockTracker
+{
+protected:
+   std::map<ulong, LockStats> locks;
+   std::vector<ulong> waitingSince; // Per core, time of its first failed acquire
+
+   LockStats &statsOf(ulong addr);
+
+public:
+   LockTracker(int processors);
+
+   void noteAtomic(ulong addr, int proc);
+   bool tryAcquire(ulong addr, int proc, ulong now);
+   bool holds(ulong addr, int proc) { return statsOf(addr).owner == proc; }
+   bool release(ulong addr, int proc);
+   int grant(ulong addr, ulong now);
+   const std::deque<int> &getWaiters(ulong addr) { return statsOf(addr).waiters; }
+   void print();
+};
+
+#endif
@@ -9,12 +9,744 @@
 using namespace std;
 
 #include "cache.h"
+#include "storebuf.h"
+#include "locks.h"
+#include "profile.h"
+#include "coreconfig.h"
+#include "sharing.h"
+#include "energy.h"
+#include "msglog.h"
+#include <vector>
 
 int COPIES_EXIST;
 int protocol;
+int num_processors;
+Cache **privateCaches;
 int c2c_FLAG;
 int Flush_no_mem_FLAG;
 int DEBUG_FLAG = 0; // enable debugg printout
+int QUIET_FLAG = 0; // -quiet: no per access state dump, statistics printed at the end
+int COLLAPSE_FLAG = 0; // -collapse: runs of same processor, same op, same block accesses are applied in one step
+int PERF_FLAG = 0;  // -perf: hardware counters for the simulator itself, needs make PROFILE=1
+char *matrix_file = NULL; // -matrix <file>: export the state-transition matrix as csv
+int CLASSIFY_FLAG = 0;     // -classify: split misses in compulsory/capacity/conflict/coherence
+int TIMING_FLAG = 0;       // -timing: latency histograms per access class, implies -classify
+int SPARSE_FLAG = 0;       // -sparse: materialize cache sets on first touch
+ulong num_sectors = 1;     // -sectors <n>: coherence state per 1/n of a block
+int SECTORS_FLAG = 0;      // -sectors given, -sectors 1 reports the block granular reference
+ulong sample_rate = 1;     // -sample <k>: simulate one in k cache sets
+SetSampler *sampler = NULL;
+char *config_file = NULL;  // -config <file>: per core size, assoc, replacement and role
+ulong sb_depth = 0;        // -sb <depth>: per core store buffers, 0 disables them
+int consistency_model = MODEL_TSO; // -model sc|tso: drain rules of the store buffers, needs -sb
+StoreBuffer **storeBuffers = NULL;
+ulong *coreCycles = NULL; // Per core clock, advanced by the latency a core observes
+LockTracker *lockTracker = NULL; // Created on the first atomic or lock operation in the trace
+int LOCK_HANDOFF_FLAG = 0;       // -lockhandoff: a release hands the lock to the oldest spinner with accesses not in the trace
+ulong handoff_accesses = 0;      // Accesses -lockhandoff added to the trace
+SharingPredictor *predictor = NULL; // -adaptive: per block sharing pattern predictor
+Cache **baseCaches = NULL;          // -adaptive: the same caches running the base protocol, for the savings report
+int ENERGY_FLAG = 0;                // -energy: per event energy and leakage report
+char *energy_file = NULL;           // -energyparams <file>: per event energies overriding the defaults, implies -energy
+EnergyParams energy_params;
+ulong victim_entries = 0;           // -victim <n>: per core fully associative victim cache, 0 disables it
+ulong wbb_depth = 0;                // -wbb <depth>: per core write-back buffer, 0 disables it
+ulong bus_clock = 0;                // Bus cycles, advanced by the latency of every access that went to the bus
+ulong base_bus_clock = 0;           // bus_clock of the base protocol caches of the adaptive mode
+char *msglog_file = NULL;           // -msglog <file>: binary log of every coherence message
+MsgLogWriter *msg_log = NULL;
+ulong msg_time = 0;                 // Logical time of the message log, one tick per access that reached Access
+
+const char *protocolName(int protocol)
+{
+	return (protocol == 0) ? "MSI" : ((protocol == 1) ? "MESI" : ((protocol == 2) ? "MOSI" : ((protocol == 3) ? "MOESI" : "COFEE")));
+}
+
+/*write every exercised (old state, event, new state) transition per processor to fname,
+and print which (state, event) pairs of the protocol the trace never exercised*/
+void exportTransitions(Cache **caches, int num_processors, int protocol, const char *fname)
+{
+	FILE *mFile = fopen(fname, "w");
+	if (mFile == 0)
+	{
+		printf("Matrix file problem\n");
+		return;
+	}
+	fprintf(mFile, "processor,old_state,event,new_state,count\n");
+	for (int i = 0; i < num_processors; i++)
+	{
+		for (uint e = 0; e < NUM_EVENTS; e++)
+			for (ulong from = 0; from < NUM_STATES; from++)
+				for (ulong to = 0; to < NUM_STATES; to++)
+				{
+					ulong count = caches[i]->getTransitions(e, from, to);
+					if (count != 0)
+						fprintf(mFile, "%d,%s,%s,%s,%lu\n", i, stateName(from), eventName(e), stateName(to), count);
+				}
+	}
+	fclose(mFile);
+
+	int pairs = 0, covered = 0;
+	printf("===== Transition coverage =====\n");
+	for (ulong from = 0; from < NUM_STATES; from++)
+	{
+		if (!stateInProtocol(protocol, from))
+			continue;
+		for (uint e = 0; e < NUM_EVENTS; e++)
+		{
+			if (from == INVALID && e != PR_READ && e != PR_WRITE)
+				continue; // Snoops and evictions of absent blocks are not transitions
+			if (e == BUS_UPDATE)
+				continue; // Not part of the base protocols
+			ulong count = 0;
+			for (int i = 0; i < num_processors; i++)
+				for (ulong to = 0; to < NUM_STATES; to++)
+					count += caches[i]->getTransitions(e, from, to);
+			pairs++;
+			if (count != 0)
+				covered++;
+			else
+				printf("not exercised: %s on %s\n", stateName(from), eventName(e));
+		}
+	}
+	printf("exercised %d of %d (state, event) pairs\n", covered, pairs);
+}
+
+/*the request an access put on the bus, told apart by which of the requester's message counters moved*/
+void logRequest(Cache *c, int proc_id, ulong addr, ulong getS, ulong getM, ulong updates)
+{
+	ulong unit = c->getSectorSize();
+	if (c->getSMsgsSent() != getS)
+		msg_log->log(msg_time, MSG_GETS, proc_id, MSG_BROADCAST, addr, MSG_CONTROL_BYTES);
+	if (c->getMMsgs != getM)
+		msg_log->log(msg_time, c->lastAccessHit() ? MSG_UPGRADE : MSG_GETM, proc_id, MSG_BROADCAST, addr, MSG_CONTROL_BYTES);
+	if (c->getUpdatesSent() != updates)
+		msg_log->log(msg_time, MSG_UPDATE, proc_id, MSG_BROADCAST, addr, MSG_CONTROL_BYTES + unit);
+}
+
+/*writebacks cache proc_id did since the last call*/
+void logWritebacks(Cache *c, int proc_id)
+{
+	vector<ulong> &addrs = c->getWritebackAddrs();
+	for (size_t k = 0; k < addrs.size(); k++)
+		msg_log->log(msg_time, MSG_WRITEBACK, proc_id, MSG_MEMORY, addrs[k], c->getSectorSize());
+	addrs.clear();
+}
+
+/*run one access through the requesting cache of caches and their snoop loop, returns its latency*/
+ulong coherentAccess(Cache **caches, int proc_id, ulong addr, uchar op)
+{
+	uint busAction;
+	bool verbose = (!QUIET_FLAG && caches == privateCaches);
+	bool logging = (msg_log != NULL && caches == privateCaches);
+	ulong getS = 0, getM = 0, updates = 0;
+	ulong unitAddr = addr & ~(caches[proc_id]->getSectorSize() - 1);
+	int supplier = MSG_MEMORY;
+	{
+		PROFILE_PHASE(PHASE_ACCESS);
+		if (caches[proc_id]->localHit(addr, op, protocol, 1))
+		{
+			if (verbose)
+				cout << "0 returned values" << endl; // No other cache was asked
+			return HIT_LATENCY;
+		}
+		if (logging)
+			msg_time++;
+		getS = caches[proc_id]->getSMsgsSent();
+		getM = caches[proc_id]->getMMsgs;
+		updates = caches[proc_id]->getUpdatesSent();
+		busAction = caches[proc_id]->Access(addr, op, protocol);
+		if (logging)
+			logRequest(caches[proc_id], proc_id, unitAddr, getS, getM, updates);
+	}
+	// Only a GetS, GetM or update reaches the other caches' tags, some hits return a bus action without sending one
+	bool onBus = (caches[proc_id]->getSMsgsSent() != getS || caches[proc_id]->getMMsgs != getM || caches[proc_id]->getUpdatesSent() != updates);
+	uint checkCount = 0;
+	uint incServicedFromOtherCore = 0;
+	uint incServicedFromMem = 0;
+	{
+		PROFILE_PHASE(PHASE_SNOOP);
+		for (int i = 0; i < num_processors; i++)
+		{
+			if (i != proc_id)
+			{
+				if (onBus)
+					caches[i]->noteSnoopProbe();
+				uint supplied = incServicedFromOtherCore;
+				ulong invalidations = caches[i]->invalidations;
+				checkCount += caches[i]->busResponse(protocol, busAction, addr, incServicedFromOtherCore, incServicedFromMem);
+				if (logging)
+				{
+					if (!supplied && incServicedFromOtherCore)
+						supplier = i;
+					if (caches[i]->invalidations != invalidations)
+						msg_log->log(msg_time, MSG_INV, proc_id, i, unitAddr, MSG_CONTROL_BYTES);
+					logWritebacks(caches[i], i);
+				}
+			}
+		}
+		if (verbose)
+			cout << checkCount << " returned values" << endl;
+		caches[proc_id]->sendBusReaction(checkCount, num_processors, addr, protocol, busAction, incServicedFromOtherCore, incServicedFromMem);
+		if (wbb_depth != 0 && !caches[proc_id]->lastAccessHit() && !incServicedFromOtherCore)
+		{
+			for (int i = 0; i < num_processors; i++)
+			{
+				if (caches[i]->bufferSupplies(addr))
+				{
+					supplier = i;
+					incServicedFromOtherCore = 1; // A buffered writeback has the data, charged like a cache-to-cache transfer
+					incServicedFromMem = 0;
+					break;
+				}
+			}
+		}
+	}
+	if (logging)
+	{
+		if (!caches[proc_id]->lastAccessHit())
+			msg_log->log(msg_time, MSG_DATA, supplier, proc_id, unitAddr, caches[proc_id]->getSectorSize());
+		logWritebacks(caches[proc_id], proc_id);
+	}
+	PROFILE_PHASE(PHASE_STATS);
+	caches[proc_id]->updateStats(incServicedFromOtherCore, incServicedFromMem);
+	if (onBus)
+		*((caches == privateCaches) ? &bus_clock : &base_bus_clock) += caches[proc_id]->getLastLatency(); // The bus is atomic, one transaction at a time
+	return caches[proc_id]->getLastLatency();
+}
+
+/*in the adaptive mode the base protocol replays the access on its own caches, then
+the predicted sharing pattern of the block picks the hint the adaptive caches get*/
+ulong adaptiveAccess(int proc_id, ulong addr, uchar op)
+{
+	if (predictor == NULL)
+		return coherentAccess(privateCaches, proc_id, addr, op);
+	coherentAccess(baseCaches, proc_id, addr, op);
+	ulong block = privateCaches[proc_id]->getBlock(addr);
+	uint pattern = predictor->predict(block);
+	predictor->observe(block, proc_id, (op != 'r' && op != OP_LL));
+	if (op == 'r' && pattern == SHARING_MIGRATORY)
+		op = OP_READ_EXCLUSIVE;
+	else if (op == 'w' && (pattern == SHARING_PRODUCER_CONSUMER || pattern == SHARING_READ_MOSTLY))
+		op = OP_WRITE_UPDATE;
+	return coherentAccess(privateCaches, proc_id, addr, op);
+}
+
+void sumCounters(ulong *totals)
+{
+	ulong counters[NUM_SAMPLE_METRICS];
+	memset(totals, 0, NUM_SAMPLE_METRICS * sizeof(ulong));
+	for (int i = 0; i < num_processors; i++)
+	{
+		privateCaches[i]->getCounters(counters);
+		for (int m = 0; m < NUM_SAMPLE_METRICS; m++)
+			totals[m] += counters[m];
+	}
+}
+
+/*charge the counter changes since before to the sampled set of addr*/
+void accountSample(int proc_id, ulong addr, ulong *before)
+{
+	ulong delta[NUM_SAMPLE_METRICS];
+	sumCounters(delta);
+	for (int m = 0; m < NUM_SAMPLE_METRICS; m++)
+		delta[m] -= before[m];
+	sampler->account(privateCaches[proc_id]->getBlock(addr), delta);
+}
+
+/*every access the simulator performs goes through here, store buffer drains and
+lock handoffs included, so when set sampling each one is charged to its own set*/
+ulong performAccess(int proc_id, ulong addr, uchar op)
+{
+	if (sampler == NULL)
+		return adaptiveAccess(proc_id, addr, op);
+	ulong before[NUM_SAMPLE_METRICS];
+	sumCounters(before);
+	ulong latency = adaptiveAccess(proc_id, addr, op);
+	accountSample(proc_id, addr, before);
+	return latency;
+}
+
+ulong performStore(int proc_id, ulong addr)
+{
+	return performAccess(proc_id, addr, 'w');
+}
+
+/*an access of a core with a store buffer: stores retire into the buffer, loads
+drain it first under SC and forward from it under TSO*/
+void bufferedAccess(int proc_id, ulong addr, uchar op)
+{
+	StoreBuffer *sb = storeBuffers[proc_id];
+	ulong block = privateCaches[proc_id]->getBlock(addr);
+	ulong &now = coreCycles[proc_id];
+
+	if (op == 'w')
+	{
+		now += sb->insert(addr, block, now) + HIT_LATENCY;
+		return;
+	}
+	if (consistency_model == MODEL_TSO && sb->forward(addr))
+	{
+		now += HIT_LATENCY;
+		return;
+	}
+	if (consistency_model == MODEL_SC)
+		now += sb->drainAll(now);
+	now += performAccess(proc_id, addr, op);
+}
+
+bool isAtomicOp(uchar op)
+{
+	return (op == OP_RMW || op == OP_LL || op == OP_SC || op == OP_ACQUIRE || op == OP_RELEASE);
+}
+
+void chargeCore(int proc_id, ulong cycles)
+{
+	if (coreCycles != NULL)
+		coreCycles[proc_id] += cycles;
+}
+
+/*-lockhandoff: a released lock goes to the oldest spinner. Every spinner re-reads the
+block the release invalidated, then the winner's test-and-set takes it in M state.
+None of these accesses is in the trace, they are counted in handoff_accesses*/
+void handOffLock(ulong addr, ulong now)
+{
+	const deque<int> &waiters = lockTracker->getWaiters(addr);
+	for (deque<int>::const_iterator it = waiters.begin(); it != waiters.end(); ++it)
+	{
+		chargeCore(*it, performAccess(*it, addr, 'r'));
+		handoff_accesses++;
+	}
+	int next = lockTracker->grant(addr, now);
+	if (next != NO_OWNER)
+	{
+		chargeCore(next, performAccess(next, addr, OP_ACQUIRE));
+		lockTracker->noteAtomic(addr, next);
+		handoff_accesses++;
+	}
+}
+
+/*atomics, LL/SC and lock operations, each acts as a fence for the core's store buffer*/
+void atomicAccess(int proc_id, ulong addr, uchar op, ulong now)
+{
+	if (lockTracker == NULL)
+		lockTracker = new LockTracker(num_processors);
+	if (storeBuffers != NULL)
+		chargeCore(proc_id, storeBuffers[proc_id]->drainAll(coreCycles[proc_id]));
+
+	ulong latency = 0;
+	switch (op)
+	{
+	case OP_LL:
+		latency = performAccess(proc_id, addr, op);
+		break;
+	case OP_SC:
+		while (!privateCaches[proc_id]->checkReservation(addr))
+		{
+			latency += performAccess(proc_id, addr, OP_LL); // Failed SC, retry the LL/SC pair
+		}
+		latency += performAccess(proc_id, addr, op);
+		lockTracker->noteAtomic(addr, proc_id);
+		break;
+	case OP_RMW:
+		latency = performAccess(proc_id, addr, op);
+		lockTracker->noteAtomic(addr, proc_id);
+		break;
+	case OP_ACQUIRE:
+		latency = performAccess(proc_id, addr, 'r'); // Test, spinners hit on their shared copy
+		if (lockTracker->holds(addr, proc_id))
+			break; // A -lockhandoff grant already did this core's test-and-set, the test hits on its copy
+		if (lockTracker->tryAcquire(addr, proc_id, now))
+		{
+			latency += performAccess(proc_id, addr, op);
+			lockTracker->noteAtomic(addr, proc_id);
+		}
+		break;
+	case OP_RELEASE:
+		latency = performAccess(proc_id, addr, op);
+		chargeCore(proc_id, latency);
+		if (lockTracker->release(addr, proc_id) && LOCK_HANDOFF_FLAG)
+			handOffLock(addr, now); // Otherwise a spinner takes the lock at its next acquire in the trace
+		return;
+	}
+	chargeCore(proc_id, latency);
+}
+
+/*background drain of every store buffer up to the latest cycle any core has
+reached, so the stores of a core that stops issuing accesses still become
+visible to the others as the trace goes on*/
+void drainStoreBuffers()
+{
+	ulong global = 0;
+	for (int i = 0; i < num_processors; i++)
+		if (coreCycles[i] > global)
+			global = coreCycles[i];
+	for (int i = 0; i < num_processors; i++)
+		storeBuffers[i]->drainUntil(global);
+}
+
+void traceAccess(int proc_id, ulong addr, uchar op, ulong now)
+{
+	if (storeBuffers != NULL)
+		drainStoreBuffers();
+	if (isAtomicOp(op))
+		atomicAccess(proc_id, addr, op, now);
+	else if (storeBuffers == NULL)
+		performAccess(proc_id, addr, op);
+	else
+		bufferedAccess(proc_id, addr, op);
+}
+
+/*apply count consecutive trace accesses of one processor with one op to one
+coherence unit (block, or sector with -sectors). Nothing can touch the unit in
+between, so after the first access the rest are local re-hits that the
+requesting cache absorbs in one step*/
+void applyRun(int proc_id, ulong addr, uchar op, ulong count, ulong now)
+{
+	traceAccess(proc_id, addr, op, now);
+	if (count == 1)
+		return;
+	if (storeBuffers == NULL && predictor == NULL) // The base caches of the adaptive mode need every access too, so no bulk re-hits there
+	{
+		PROFILE_PHASE(PHASE_ACCESS);
+		ulong before[NUM_SAMPLE_METRICS];
+		if (sampler != NULL)
+			sumCounters(before);
+		if (privateCaches[proc_id]->localHit(addr, op, protocol, count - 1))
+		{
+			if (sampler != NULL)
+				accountSample(proc_id, addr, before);
+			return;
+		}
+	}
+	for (ulong i = 1; i < count; i++)
+		traceAccess(proc_id, addr, op, now + i);
+}
+
+/*data moved per miss fill and writeback is one sector instead of one block. A
+sector miss may be one a block granular cache would not have taken, so the
+saving is the difference to the bus data bytes of a -sectors 1 run*/
+void printSectors()
+{
+	ulong moved = 0, spared = 0;
+	printf("===== Sectored caches (%lu sectors of %lu bytes) =====\n", num_sectors, privateCaches[0]->getSectorSize());
+	for (int i = 0; i < num_processors; i++)
+	{
+		Cache *c = privateCaches[i];
+		moved += (c->getRM() + c->getWM() + c->getWB()) * c->getSectorSize();
+		spared += c->getSectorsSpared();
+	}
+	printf("bus data bytes: %lu\n", moved);
+	printf("sector invalidations avoided: %lu\n", spared);
+}
+
+/*apply one trace record, a single access or a collapsed run starting at trace
+access first, with the state dump and running totals around it unless -quiet*/
+void processRecord(int proc_id, ulong addr, uchar op, ulong count, ulong first)
+{
+	if (!QUIET_FLAG)
+	{
+		PROFILE_PHASE(PHASE_PRINT);
+		cout << "===== before access ===============" << endl;
+		for (int i = 0; i < num_processors; i++)
+		{
+			privateCaches[i]->printState(addr, i);
+		}
+	}
+
+	applyRun(proc_id, addr, op, count, first);
+	if (QUIET_FLAG)
+		return;
+	ulong total_invalidations = 0, total_other_cache = 0, total_writebacks = 0, total_getM = 0, total_silent = 0;
+	{
+		PROFILE_PHASE(PHASE_STATS);
+		for (int i = 0; i < num_processors; i++)
+		{
+			total_other_cache += privateCaches[i]->servicedFromOtherCore;
+			total_writebacks += privateCaches[i]->writeBacks;
+			total_getM += privateCaches[i]->getMMsgs;
+			total_invalidations += privateCaches[i]->invalidations;
+			total_silent += privateCaches[i]->silentUpgrade;
+		}
+	}
+	PROFILE_PHASE(PHASE_PRINT);
+	cout << "===== after access ===============" << endl;
+	for (int i = 0; i < num_processors; i++)
+	{
+		privateCaches[i]->printState(addr, i);
+	}
+	cout << "Total invalidations: " << total_invalidations << endl;
+	cout << "Total other cache: " << total_other_cache << endl;
+	cout << "Total writebacks: " << total_writebacks << endl;
+	cout << "Total getM: " << total_getM << endl;
+	cout << "Total silent: " << total_silent << endl;
+	cout << "Total access: " << first + count << endl;
+}
+
+/*coherence traffic each core generates and receives, to compare big and little cores*/
+void printCores()
+{
+	printf("===== Per core coherence traffic =====\n");
+	for (int i = 0; i < num_processors; i++)
+	{
+		Cache *c = privateCaches[i];
+		printf("Processor number : %d  sets: %lu  misses: %lu  getS sent: %lu  getM sent: %lu  invalidations received: %lu  snoops left to memory: %lu\n",
+			   i, c->getSets(), c->getRM() + c->getWM(), c->getSMsgsSent(), c->getMMsgs, c->invalidations, c->getRedirectedToMem());
+	}
+}
+
+/*coherence traffic of the adaptive caches against the base protocol on the same trace*/
+void printAdaptive()
+{
+	predictor->print();
+	ulong base[4] = {0, 0, 0, 0}, adaptive[4] = {0, 0, 0, 0};
+	ulong readExclusives = 0, updatesReceived = 0;
+	for (int i = 0; i < num_processors; i++)
+	{
+		base[0] += baseCaches[i]->getSMsgsSent();
+		base[1] += baseCaches[i]->getMMsgs;
+		base[2] += baseCaches[i]->invalidations;
+		base[3] += baseCaches[i]->writeBacks;
+		adaptive[0] += privateCaches[i]->getSMsgsSent();
+		adaptive[1] += privateCaches[i]->getMMsgs + privateCaches[i]->getUpdatesSent();
+		adaptive[2] += privateCaches[i]->invalidations;
+		adaptive[3] += privateCaches[i]->writeBacks;
+		readExclusives += privateCaches[i]->getReadExclusives();
+		updatesReceived += privateCaches[i]->getUpdatesReceived();
+	}
+	const char *names[4] = {"getS messages", "getM + update messages", "invalidations", "writebacks"};
+	printf("===== Adaptive protocol vs base =====\n");
+	printf("read misses taken exclusive: %lu  copies updated instead of invalidated: %lu\n", readExclusives, updatesReceived);
+	for (int m = 0; m < 4; m++)
+		printf("%-24s base: %lu  adaptive: %lu  saved: %ld\n", names[m], base[m], adaptive[m], (long)(base[m] - adaptive[m]));
+	printf("%-24s base: %lu  adaptive: %lu  saved: %ld\n", "total messages", base[0] + base[1], adaptive[0] + adaptive[1],
+		   (long)(base[0] + base[1] - adaptive[0] - adaptive[1]));
+}
+
+/*energy relevant events of one cache. Every access reads the tags and the data array,
+fills and writes write it, writebacks and blocks sent to other cores read it*/
+CacheActivity activityOf(Cache *c, ulong cycles)
+{
+	ulong n[NUM_SAMPLE_METRICS];
+	c->getCounters(n);
+	ulong unit = c->getSectorSize();
+	ulong misses = n[SAMPLE_READ_MISSES] + n[SAMPLE_WRITE_MISSES];
+	CacheActivity a;
+	a.assoc = c->getAssoc();
+	a.sizeBytes = c->getSize();
+	a.lookups = n[SAMPLE_READS] + n[SAMPLE_WRITES];
+	a.snoops = c->getSnoopProbes();
+	a.dataReads = n[SAMPLE_READS] + n[SAMPLE_WRITEBACKS] + n[SAMPLE_FROM_OTHER_CORE];
+	a.dataWrites = n[SAMPLE_WRITES] + misses;
+	a.messages = n[SAMPLE_GETS] + n[SAMPLE_GETM] + c->getUpdatesSent() + c->getMemWrites();
+	a.bytes = (misses + c->getMemWrites() + c->getUpdatesSent()) * unit;
+	a.memoryBytes = (n[SAMPLE_FROM_MEM] + c->getMemWrites()) * unit;
+	a.cycles = cycles;
+	return a;
+}
+
+/*energy of one set of caches, every cache leaks for as long as the busiest core ran*/
+double cachesEnergy(Cache **caches, const EnergyParams &params, const char *label, bool perCore)
+{
+	ulong cycles = 0;
+	for (int i = 0; i < num_processors; i++)
+		if (caches[i]->getBusyCycles() > cycles)
+			cycles = caches[i]->getBusyCycles();
+	double scale = (sampler != NULL) ? sampler->getScale() : 1.0;
+	EnergyModel model(params);
+	for (int i = 0; i < num_processors; i++)
+	{
+		double pJ = model.add(activityOf(caches[i], cycles));
+		if (perCore)
+			printf("Processor number : %d  energy: %.3f nJ\n", i, pJ * scale / 1000.0);
+	}
+	model.scale(scale);
+	model.print(label);
+	return model.total();
+}
+
+void printEnergy()
+{
+	printf("===== Energy =====\n");
+	double total = cachesEnergy(privateCaches, energy_params, protocolName(protocol), true);
+	if (baseCaches != NULL)
+	{
+		double base = cachesEnergy(baseCaches, energy_params, "base protocol", false);
+		printf("adaptive saved: %.3f nJ\n", (base - total) / 1000.0);
+	}
+	printf("ENERGY: %s L1_SIZE: %lu L1_ASSOC: %lu L1_BLOCKSIZE: %lu PROCESSORS: %d TOTAL: %.3f nJ\n", protocolName(protocol),
+		   privateCaches[0]->getSize(), privateCaches[0]->getAssoc(), privateCaches[0]->getLineSize(), num_processors, total / 1000.0);
+}
+
+/*misses the victim caches absorbed and the traffic the write-back buffers hid*/
+void printVictims()
+{
+	printf("===== Victim caches (%lu entries) and write-back buffers (depth %lu) =====\n", victim_entries, wbb_depth);
+	ulong hits = 0, supplied = 0;
+	for (int i = 0; i < num_processors; i++)
+	{
+		Cache *c = privateCaches[i];
+		WritebackBuffer *wbb = c->getWritebackBuffer();
+		printf("Processor number : %d\n", i);
+		if (victim_entries != 0)
+			printf("  victim inserts: %lu  victim hits: %lu\n", c->getVictimInserts(), c->getVictimHits());
+		if (wbb != NULL)
+		{
+			printf("  writebacks: %lu  coalesced: %lu  written to memory: %lu  served misses: %lu\n", wbb->writebacks, wbb->coalesced, wbb->written, wbb->supplied);
+			printf("  buffer full stalls: %lu  stall cycles: %lu\n", wbb->fullStalls, wbb->stallCycles);
+			supplied += wbb->supplied;
+		}
+		hits += c->getVictimHits();
+	}
+	printf("misses avoided by victim hits: %lu\n", hits);
+	printf("memory fetches avoided by buffered writebacks: %lu\n", supplied);
+}
+
+void printAtomics()
+{
+	lockTracker->print();
+	if (LOCK_HANDOFF_FLAG)
+		printf("lock handoff accesses added to the trace: %lu (included in the statistics)\n", handoff_accesses);
+	for (int i = 0; i < num_processors; i++)
+		printf("Processor number : %d  atomics: %lu  SC failures: %lu\n", i, privateCaches[i]->getAtomics(), privateCaches[i]->getSCFailures());
+}
+
+void printStoreBuffers()
+{
+	printf("===== Store buffers (depth %lu, %s) =====\n", sb_depth, (consistency_model == MODEL_SC) ? "SC" : "TSO");
+	for (int i = 0; i < num_processors; i++)
+	{
+		StoreBuffer *sb = storeBuffers[i];
+		ulong hidden = (sb->drainCycles > sb->stallCycles) ? sb->drainCycles - sb->stallCycles : 0;
+		printf("Processor number : %d\n", i);
+		printf("  stores: %lu  coalesced: %lu  performed: %lu  forwarded loads: %lu\n", sb->stores, sb->coalesced, sb->drained, sb->forwarded);
+		printf("  buffer full stalls: %lu  stall cycles: %lu  store latency hidden: %lu cycles\n", sb->fullStalls, sb->stallCycles, hidden);
+		printf("  core cycles: %lu\n", coreCycles[i]);
+	}
+}
+
+void printMissClasses(Cache **caches, int num_processors)
+{
+	printf("===== Miss classification =====\n");
+	for (int i = 0; i < num_processors; i++)
+	{
+		printf("Processor number : %d\n", i);
+		for (uint c = MISS_COMPULSORY; c < NUM_ACCESS_CLASSES; c++)
+			if (c != MISS_SECTOR || num_sectors > 1)
+				printf("  %-12s misses: %lu\n", accessClassName(c), caches[i]->getAccessClass(c));
+	}
+	if (!TIMING_FLAG)
+		return;
+	printf("===== Access latency (cycles) =====\n");
+	for (uint c = 0; c < NUM_ACCESS_CLASSES; c++)
+	{
+		if (c == MISS_SECTOR && num_sectors == 1)
+			continue;
+		LatencyHistogram all;
+		for (int i = 0; i < num_processors; i++)
+			all.merge(caches[i]->getLatency(c));
+		all.print(accessClassName(c));
+	}
+}
+
+/*end of run reports of every enabled feature*/
+void printReports(int total_access, ulong runs)
+{
+	if (storeBuffers != NULL)
+	{
+		printStoreBuffers();
+	}
+	if (lockTracker != NULL)
+	{
+		printAtomics();
+	}
+	if (matrix_file != NULL)
+	{
+		exportTransitions(privateCaches, num_processors, protocol, matrix_file);
+	}
+	if (CLASSIFY_FLAG)
+	{
+		printMissClasses(privateCaches, num_processors);
+	}
+	if (SECTORS_FLAG)
+	{
+		printSectors();
+	}
+	if (SPARSE_FLAG)
+	{
+		ulong touched = 0, configured = 0, bytes = 0;
+		for (int i = 0; i < num_processors; i++)
+		{
+			touched += privateCaches[i]->getSparseSets()->getSets();
+			configured += privateCaches[i]->getSets();
+			bytes += privateCaches[i]->getSparseSets()->getBytes();
+		}
+		printf("===== Sparse set storage =====\n");
+		printf("sets materialized: %lu of %lu\n", touched, configured);
+		printf("set storage bytes: %lu\n", bytes);
+	}
+	if (sampler != NULL)
+	{
+		sampler->print();
+	}
+	if (config_file != NULL)
+	{
+		printCores();
+	}
+	if (predictor != NULL)
+	{
+		printAdaptive();
+	}
+	if (victim_entries != 0 || wbb_depth != 0)
+	{
+		printVictims();
+	}
+	if (ENERGY_FLAG)
+	{
+		printEnergy();
+	}
+	if (msg_log != NULL)
+	{
+		msg_log->close();
+		printf("MESSAGE LOG: %lu records\n", (ulong)msg_log->records);
+	}
+	if (COLLAPSE_FLAG)
+	{
+		printf("TRACE ACCESSES: %d in %lu runs\n", total_access, runs);
+	}
+	if (QUIET_FLAG || sampler != NULL) // Sampled runs always end with the extrapolated totals
+	{
+		for (int i = 0; i < num_processors; i++)
+		{
+			privateCaches[i]->printStats(i);
+		}
+	}
+}
+
+/*end of run, every buffered writeback reaches memory and counts as a memory write*/
+void drainWritebackBuffers(Cache **caches)
+{
+	for (int i = 0; i < num_processors; i++)
+		caches[i]->getWritebackBuffer()->drain();
+}
+
+Cache **createCaches(const vector<CoreConfig> &configs, int blk_size, const ulong *clock)
+{
+	Cache **caches = new Cache *[num_processors];
+	for (int i = 0; i < num_processors; i++)
+	{
+		caches[i] = new Cache(configs[i].size, configs[i].assoc, blk_size, SPARSE_FLAG);
+		caches[i]->setReplacement(configs[i].replacement);
+		caches[i]->setRole(configs[i].role);
+		if (num_sectors > 1)
+			caches[i]->enableSectors(num_sectors);
+		if (victim_entries != 0)
+			caches[i]->enableVictimCache(victim_entries);
+		if (wbb_depth != 0)
+			caches[i]->enableWritebackBuffer(wbb_depth, clock);
+	}
+	return caches;
+}
 
 int main(int argc, char *argv[])
 {
@@ -27,13 +759,31 @@ int main(int argc, char *argv[])
 	int proc_id;
 	unsigned char op;
 	unsigned long addr;
-	unsigned int busAction;
-	unsigned int checkCount;
 
 	if (argv[1] == NULL)
 	{
 		printf("input format: ");
-		printf("./smp_cache <cache_size> <assoc> <block_size> <num_processors> <protocol> <trace_file> \n");
+		printf("./smp_cache <cache_size> <assoc> <block_size> <num_processors> <protocol> <trace_file> [options]\n");
+		printf("trace ops: r, w, a (atomic RMW), l (load-linked), s (store-conditional), k (lock acquire), u (lock release)\n");
+		printf("options: -matrix <file>  export the state-transition matrix as csv\n");
+		printf("         -classify       classify misses as compulsory/capacity/conflict/coherence\n");
+		printf("         -timing         latency histograms per hit/miss class (implies -classify)\n");
+		printf("         -quiet          no per access dump, print the statistics at the end\n");
+		printf("         -collapse       apply runs of same processor, op and block accesses in one step\n");
+		printf("         -perf           with make PROFILE=1, add hardware counters to the phase profile\n");
+		printf("         -sparse         allocate cache sets on first touch\n");
+		printf("         -sample <k>     simulate one in k cache sets and extrapolate printStats\n");
+		printf("         -config <file>  per core \"<proc>[-<proc>] <size> <assoc> [lru|fifo|random] [supplier|memory]\"\n");
+		printf("         -sectors <n>    per sector coherence state, n sectors per block\n");
+		printf("         -adaptive       predict migratory/producer-consumer/read-mostly blocks and adapt the protocol\n");
+		printf("         -victim <n>     per core fully associative victim cache of n blocks\n");
+		printf("         -wbb <depth>    per core coalescing write-back buffer of <depth> blocks\n");
+		printf("         -energy         per event energy and leakage of caches, bus and memory\n");
+		printf("         -msglog <file>  binary log of every coherence message, read it with msgreplay\n");
+		printf("         -energyparams <file>  \"<name> <pJ>\" lines overriding the default energies, implies -energy\n");
+		printf("         -sb <depth>     per core store buffers of <depth> entries\n");
+		printf("         -model sc|tso   store buffer drain rules (default tso)\n");
+		printf("         -lockhandoff    a lock release hands the lock to the oldest spinner with extra accesses\n");
 		exit(0);
 	}
 
@@ -41,10 +791,139 @@ int main(int argc, char *argv[])
 	int cache_size = atoi(argv[1]);
 	int cache_assoc = atoi(argv[2]);
 	int blk_size = atoi(argv[3]);
-	int num_processors = atoi(argv[4]); /*1, 2, 4, 8*/
-	int protocol = atoi(argv[5]);		/*0:MSI, 1:MESI, 2:MOSI*/
+	num_processors = atoi(argv[4]); /*1, 2, 4, 8*/
+	protocol = atoi(argv[5]);		/*0:MSI, 1:MESI, 2:MOSI*/
 	char *fname = (char *)malloc(50);
 	fname = argv[6];
+	bool model_set = false;
+	for (int i = 7; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-matrix") && i + 1 < argc)
+		{
+			matrix_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-classify"))
+		{
+			CLASSIFY_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-quiet"))
+		{
+			QUIET_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-collapse"))
+		{
+			COLLAPSE_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-sectors") && i + 1 < argc)
+		{
+			SECTORS_FLAG = 1;
+			num_sectors = atoi(argv[++i]);
+			if (num_sectors == 0 || num_sectors > MAX_SECTORS || (num_sectors & (num_sectors - 1)) != 0)
+			{
+				printf("Sectors must be a power of two up to %d\n", MAX_SECTORS);
+				exit(0);
+			}
+			if (num_sectors > (ulong)blk_size)
+			{
+				printf("Sectors must not outnumber the %d bytes of a block\n", blk_size); // A sector is at least one byte
+				exit(0);
+			}
+		}
+		else if (!strcmp(argv[i], "-perf"))
+		{
+#ifndef SIM_PROFILE
+			printf("-perf needs a profiling build (make PROFILE=1)\n");
+			exit(0);
+#endif
+			PERF_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-config") && i + 1 < argc)
+		{
+			config_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-sample") && i + 1 < argc)
+		{
+			sample_rate = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-msglog") && i + 1 < argc)
+		{
+			msglog_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-victim") && i + 1 < argc)
+		{
+			victim_entries = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-wbb") && i + 1 < argc)
+		{
+			wbb_depth = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-energy"))
+		{
+			ENERGY_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-energyparams") && i + 1 < argc)
+		{
+			ENERGY_FLAG = 1;
+			energy_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-adaptive"))
+		{
+			predictor = new SharingPredictor();
+		}
+		else if (!strcmp(argv[i], "-lockhandoff"))
+		{
+			LOCK_HANDOFF_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-sparse"))
+		{
+			SPARSE_FLAG = 1;
+		}
+		else if (!strcmp(argv[i], "-sb") && i + 1 < argc)
+		{
+			char *end;
+			long depth = strtol(argv[++i], &end, 10);
+			if (*end != '\0' || depth <= 0)
+			{
+				printf("Store buffer depth must be a positive number\n");
+				exit(0);
+			}
+			sb_depth = depth;
+		}
+		else if (!strcmp(argv[i], "-model") && i + 1 < argc)
+		{
+			model_set = true;
+			i++;
+			if (!strcmp(argv[i], "sc"))
+				consistency_model = MODEL_SC;
+			else if (!strcmp(argv[i], "tso"))
+				consistency_model = MODEL_TSO;
+			else
+			{
+				printf("Unknown consistency model %s\n", argv[i]);
+				exit(0);
+			}
+		}
+		else if (!strcmp(argv[i], "-timing"))
+		{
+			CLASSIFY_FLAG = 1;
+			TIMING_FLAG = 1;
+		}
+		else
+		{
+			printf("Unknown option %s\n", argv[i]);
+			exit(0);
+		}
+	}
+
+	if (model_set && sb_depth == 0)
+	{
+		printf("-model needs store buffers (-sb <depth>)\n");
+		exit(0);
+	}
+
+	defaultEnergyParams(energy_params);
+	if (energy_file != NULL && !loadEnergyParams(energy_file, energy_params))
+		exit(0);
 
 	//****************************************************//
 	//**printf("===== Simulator configuration =====\n");**//
@@ -55,17 +934,70 @@ int main(int argc, char *argv[])
 	printf("L1_ASSOC: %d\n", cache_assoc);
 	printf("L1_BLOCKSIZE: %d\n", blk_size);
 	printf("NUMBER OF PROCESSORS: %d\n", num_processors);
-	printf("COHERENCE PROTOCOL: %s\n", (protocol == 0) ? "MSI" : ((protocol == 1) ? "MESI" : ((protocol == 2) ? "MOSI" : ((protocol == 3) ? "MOESI" : "COFEE"))));
+	printf("COHERENCE PROTOCOL: %s\n", protocolName(protocol));
 	printf("TRACE FILE: %.27s\n", &fname[3]); // no "../"
 
 	//*********************************************//
 	//*****create an array of caches here**********//
 	//*********************************************//
 
-	Cache *privateCaches[num_processors];
+	CoreConfig defaults = {cache_size, cache_assoc, REPL_LRU, ROLE_SUPPLIER};
+	vector<CoreConfig> configs(num_processors, defaults);
+	if (config_file != NULL)
+	{
+		if (!loadCoreConfigs(config_file, configs))
+			exit(0);
+		for (int i = 0; i < num_processors; i++)
+		{
+			int sets = configs[i].size / (blk_size * configs[i].assoc);
+			if (sets == 0 || (sets & (sets - 1)) != 0 || sets * blk_size * configs[i].assoc != configs[i].size)
+			{
+				printf("Processor %d: size %d with assoc %d does not give a power of two number of sets\n", i, configs[i].size, configs[i].assoc);
+				exit(0);
+			}
+			printf("CORE %d: L1_SIZE: %d L1_ASSOC: %d REPLACEMENT: %s ROLE: %s\n", i, configs[i].size, configs[i].assoc,
+				   replacementName(configs[i].replacement), roleName(configs[i].role));
+		}
+	}
+
+	privateCaches = createCaches(configs, blk_size, &bus_clock);
+	if (predictor != NULL)
+		baseCaches = createCaches(configs, blk_size, &base_bus_clock);
 	for (int i = 0; i < num_processors; i++)
 	{
-		privateCaches[i] = new Cache(cache_size, blk_size, cache_assoc);
+		if (TIMING_FLAG)
+			privateCaches[i]->enableTiming();
+		else if (CLASSIFY_FLAG)
+			privateCaches[i]->enableMissClassification();
+	}
+	if (sample_rate > 1)
+	{
+		ulong min_sets = privateCaches[0]->getSets();
+		for (int i = 1; i < num_processors; i++)
+			if (privateCaches[i]->getSets() < min_sets)
+				min_sets = privateCaches[i]->getSets();
+		// Sampling on the index bits of the smallest cache keeps whole sets of the larger ones
+		sampler = new SetSampler(min_sets, sample_rate);
+		for (int i = 0; i < num_processors; i++)
+			privateCaches[i]->setSampleScale(sampler->getScale());
+	}
+	if (msglog_file != NULL)
+	{
+		msg_log = MsgLogWriter::open(msglog_file, blk_size / num_sectors, num_processors, protocol);
+		if (msg_log == NULL)
+			exit(0);
+		for (int i = 0; i < num_processors; i++)
+			privateCaches[i]->enableWritebackLog();
+	}
+	if (sb_depth != 0)
+	{
+		storeBuffers = new StoreBuffer *[num_processors];
+		coreCycles = new ulong[num_processors];
+		for (int i = 0; i < num_processors; i++)
+		{
+			storeBuffers[i] = new StoreBuffer(i, sb_depth, performStore);
+			coreCycles[i] = 0;
+		}
 	}
 
 	pFile = fopen(fname, "r");
@@ -79,64 +1011,77 @@ int main(int argc, char *argv[])
 	//*****propagate each request down through memory hierarchy**********//
 	//*****by calling cachesArray[processor#]->Access(...)***************//
 	///******************************************************************//
+	PROFILE_BEGIN(PERF_FLAG);
 	int total_access = 0;
+	int run_proc = 0;
+	unsigned char run_op = 0;
+	ulong run_addr = 0, run_unit = 0, run_length = 0, runs = 0;
 	while ((getline(&line, &len, pFile)) != -1)
 	{ // iterate line by line
 		// ===== parsing arguments ===============
-		proc_id = atoi(strtok(line, delimiter));
-		op = strtok(NULL, delimiter)[0];
-		sscanf(((string)(strtok(NULL, delimiter))).c_str(), "%lx", &addr);
-
-		// cout<<"Processor ID is "<<proc_id << ", Operation is "<<op<<", address is "<<addr<<endl;
-		cout << "===== before access ===============" << endl;
-		for (int i = 0; i < num_processors; i++)
 		{
-			privateCaches[i]->printState(addr, i);
+			PROFILE_PHASE(PHASE_PARSE);
+			proc_id = atoi(strtok(line, delimiter));
+			op = strtok(NULL, delimiter)[0];
+			sscanf(((string)(strtok(NULL, delimiter))).c_str(), "%lx", &addr);
 		}
 
-		busAction = privateCaches[proc_id]->Access(addr, op, protocol);
-		checkCount = 0;
-		uint incServicedFromOtherCore = 0;
-		uint incServicedFromMem = 0;
-		for (int i = 0; i < num_processors; i++)
+		if (sampler != NULL && !sampler->isSampled(privateCaches[proc_id]->getBlock(addr)))
 		{
-			if (i != proc_id)
-			{
-				checkCount += privateCaches[i]->busResponse(protocol, busAction, addr, incServicedFromOtherCore, incServicedFromMem);
-			}
+			continue; // Unsampled set, never reaches Access
 		}
-		cout << checkCount << " returned values" << endl;
-		privateCaches[proc_id]->sendBusReaction(checkCount, num_processors, addr, protocol, busAction, incServicedFromOtherCore, incServicedFromMem);
-		privateCaches[proc_id]->updateStats(incServicedFromOtherCore, incServicedFromMem);
-		cout << "===== after access ===============" << endl;
-		for (int i = 0; i < num_processors; i++)
+		if (COLLAPSE_FLAG)
 		{
-			privateCaches[i]->printState(addr, i);
-		}
-		ulong total_invalidations = 0, total_other_cache = 0, total_writebacks = 0, total_getM = 0, total_silent = 0;
-		for (int i = 0; i < num_processors; i++)
-		{
-			total_other_cache += privateCaches[i]->servicedFromOtherCore;
-			total_writebacks += privateCaches[i]->writeBacks;
-			total_getM += privateCaches[i]->getMMsgs;
-			total_invalidations += privateCaches[i]->invalidations;
-			total_silent += privateCaches[i]->silentUpgrade;
+			// Store buffers forward by address, so with them a run is one address
+			ulong unit = (storeBuffers != NULL) ? addr : addr / privateCaches[proc_id]->getSectorSize();
+			if (run_length != 0 && proc_id == run_proc && op == run_op && unit == run_unit)
+			{
+				run_length++;
+				continue;
+			}
+			if (run_length != 0)
+			{
+				processRecord(run_proc, run_addr, run_op, run_length, total_access);
+				total_access += run_length;
+				runs++;
+			}
+			run_proc = proc_id;
+			run_op = op;
+			run_addr = addr;
+			run_unit = unit;
+			run_length = 1;
+			continue;
 		}
-		cout << "Total invalidations: " << total_invalidations << endl;
-		cout << "Total other cache: " << total_other_cache << endl;
-		cout << "Total writebacks: " << total_writebacks << endl;
-		cout << "Total getM: " << total_getM << endl;
-		cout << "Total silent: " << total_silent << endl;
+
+		// cout<<"Processor ID is "<<proc_id << ", Operation is "<<op<<", address is "<<addr<<endl;
+		processRecord(proc_id, addr, op, 1, total_access);
 		total_access++;
-		cout << "Total access: " << total_access << endl;
 	}
 	fclose(pFile);
+	if (run_length != 0)
+	{
+		processRecord(run_proc, run_addr, run_op, run_length, total_access);
+		total_access += run_length;
+		runs++;
+	}
+	if (storeBuffers != NULL)
+	{
+		for (int i = 0; i < num_processors; i++)
+			storeBuffers[i]->flush();
+	}
+	if (wbb_depth != 0)
+	{
+		drainWritebackBuffers(privateCaches);
+		if (baseCaches != NULL)
+			drainWritebackBuffers(baseCaches);
+	}
 
 	//********************************//
 	// print out all caches' statistics //
 	//********************************//
-	// for (int i = 0; i < num_processors; i++)
-	// {
-	// 	privateCaches[i]->printStats(i);
-	// }
+	{
+		PROFILE_PHASE(PHASE_PRINT);
+		printReports(total_access, runs);
+	}
+	PROFILE_END(total_access);
 }
@@ -0,0 +1,151 @@
+/*******************************************************
+                          missclass.cc
+********************************************************/
+
+#include "missclass.h"
+
+#define NIL ((uint)~0U)
+#define NO_BLOCK (~0UL)
+
+const char *accessClassName(uint accessClass)
+{
+   switch (accessClass)
+   {
+   case ACCESS_HIT:
+      return "hit";
+   case MISS_COMPULSORY:
+      return "compulsory";
+   case MISS_CAPACITY:
+      return "capacity";
+   case MISS_CONFLICT:
+      return "conflict";
+   case MISS_COHERENCE:
+      return "coherence";
+   case MISS_SECTOR:
+      return "sector";
+   }
+   return "?";
+}
+
+MissClassifier::MissClassifier(ulong numLines)
+{
+   capacity = numLines;
+   used = 0;
+   head = tail = NIL;
+   seen.resize(SEEN_BITS / 64, 0);
+   invalidated.resize(INVALIDATED_SLOTS, NO_BLOCK);
+}
+
+/*k-th Bloom filter bit of block, double hashing on two halves of one multiplicative hash*/
+ulong MissClassifier::seenBit(ulong block, uint k)
+{
+   ulong h = block * 0x9E3779B97F4A7C15UL;
+   return ((h >> 32) + k * ((h & 0xFFFFFFFFUL) | 1)) & (SEEN_BITS - 1);
+}
+
+bool MissClassifier::wasSeen(ulong block)
+{
+   for (uint k = 0; k < SEEN_HASHES; k++)
+   {
+      ulong bit = seenBit(block, k);
+      if (!(seen[bit / 64] & (1UL << (bit % 64))))
+         return false;
+   }
+   return true;
+}
+
+void MissClassifier::unlink(uint i)
+{
+   if (prev[i] != NIL)
+      next[prev[i]] = next[i];
+   else
+      head = next[i];
+   if (next[i] != NIL)
+      prev[next[i]] = prev[i];
+   else
+      tail = prev[i];
+}
+
+void MissClassifier::pushFront(uint i)
+{
+   prev[i] = NIL;
+   next[i] = head;
+   if (head != NIL)
+      prev[head] = i;
+   head = i;
+   if (tail == NIL)
+      tail = i;
+}
+
+/*called on a miss of the real cache, before touch()*/
+uint MissClassifier::classify(ulong block)
+{
+   ulong slot = invalidatedSlot(block);
+   if (invalidated[slot] == block)
+   {
+      invalidated[slot] = NO_BLOCK;
+      return MISS_COHERENCE; // The block was here until another core took it away
+   }
+   if (!wasSeen(block))
+      return MISS_COMPULSORY;
+   if (where.find(block) != where.end())
+      return MISS_CONFLICT; // A fully associative cache of the same size would have hit
+   return MISS_CAPACITY;
+}
+
+/*make block the MRU line of the shadow cache, called on every access*/
+void MissClassifier::touch(ulong block)
+{
+   std::unordered_map<ulong, uint>::iterator it = where.find(block);
+   uint i;
+   if (it != where.end())
+   {
+      i = it->second;
+      unlink(i);
+   }
+   else
+   {
+      for (uint k = 0; k < SEEN_HASHES; k++)
+      {
+         ulong bit = seenBit(block, k);
+         seen[bit / 64] |= 1UL << (bit % 64);
+      }
+      if (used < capacity)
+      {
+         i = used++; // Shadow lines grow with the footprint, not the configured size
+         blocks.push_back(0);
+         prev.push_back(NIL);
+         next.push_back(NIL);
+      }
+      else
+      {
+         i = tail;
+         unlink(i);
+         where.erase(blocks[i]);
+      }
+      blocks[i] = block;
+      where[block] = i;
+   }
+   pushFront(i);
+}
+
+/*a remote GetM took the block, the next miss to it is a coherence miss*/
+void MissClassifier::noteInvalidation(ulong block)
+{
+   invalidated[invalidatedSlot(block)] = block;
+   std::unordered_map<ulong, uint>::iterator it = where.find(block);
+   if (it == where.end())
+      return;
+   uint i = it->second;
+   unlink(i);
+   where.erase(it);
+   // Move the freed shadow line to the LRU end so it is reused first
+   prev[i] = tail;
+   next[i] = NIL;
+   if (tail != NIL)
+      next[tail] = i;
+   tail = i;
+   if (head == NIL)
+      head = i;
+   blocks[i] = ~0UL;
+}
@@ -0,0 +1,64 @@
+/*******************************************************
+                          missclass.h
+********************************************************/
+
+#ifndef MISSCLASS_H
+#define MISSCLASS_H
+
+#include <vector>
+#include <unordered_map>
+
+typedef unsigned long ulong;
+typedef unsigned int uint;
+
+/****outcome of an access, a hit or one of the four miss classes****/
+enum
+{
+   ACCESS_HIT = 0,
+   MISS_COMPULSORY,
+   MISS_CAPACITY,
+   MISS_CONFLICT,
+   MISS_COHERENCE,
+   MISS_SECTOR, // Sectored caches only: the block is resident, the sector is not
+   NUM_ACCESS_CLASSES
+};
+
+const char *accessClassName(uint);
+
+#define SEEN_BITS (1UL << 21)      // Bloom filter of touched blocks, 256 KB
+#define SEEN_HASHES 3
+#define INVALIDATED_BITS 14 // Table of blocks lost to a remote invalidation, 128 KB
+#define INVALIDATED_SLOTS (1UL << INVALIDATED_BITS)
+
+/*per processor shadow state used to explain misses: a fully associative LRU
+cache with as many lines as the real one, a Bloom filter of the blocks ever
+touched and a direct-mapped table of the blocks lost to a remote invalidation.
+Both are fixed in size whatever the footprint. A Bloom false positive turns a
+compulsory miss into a capacity or conflict one, and an invalidated block
+pushed out of its slot by a later one misses as capacity or conflict too*/
+class MissClassifier
+{
+protected:
+   ulong capacity, used;
+   uint head, tail; // LRU list runs from head (MRU) to tail (LRU)
+   std::vector<ulong> blocks;
+   std::vector<uint> prev, next; // links between shadow lines, indexes into blocks
+   std::unordered_map<ulong, uint> where;
+   std::vector<ulong> seen;        // SEEN_BITS bits
+   std::vector<ulong> invalidated; // Block per slot, NO_BLOCK when free
+
+   void unlink(uint);
+   void pushFront(uint);
+   ulong seenBit(ulong block, uint k);
+   bool wasSeen(ulong block);
+   ulong invalidatedSlot(ulong block) { return (block * 0x9E3779B97F4A7C15UL) >> (64 - INVALIDATED_BITS); }
+
+public:
+   MissClassifier(ulong numLines);
+
+   uint classify(ulong block);
+   void touch(ulong block);
+   void noteInvalidation(ulong block);
+};
+
+#endif
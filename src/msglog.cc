@@ -0,0 +1,162 @@
+/*******************************************************
+                          msglog.cc
+********************************************************/
+
+#include "msglog.h"
+
+#define MSGLOG_BUFFER_RECORDS 16384 // Records per buffer, 384 KB
+
+const char *msgTypeName(unsigned int type)
+{
+   switch (type)
+   {
+   case MSG_GETS:
+      return "GetS";
+   case MSG_GETM:
+      return "GetM";
+   case MSG_UPGRADE:
+      return "Upgrade";
+   case MSG_UPDATE:
+      return "Update";
+   case MSG_INV:
+      return "Inv";
+   case MSG_DATA:
+      return "Data";
+   case MSG_WRITEBACK:
+      return "Writeback";
+   }
+   return "?";
+}
+
+MsgLogWriter::MsgLogWriter(FILE *f, const MsgLogHeader &header)
+{
+   file = f;
+   records = 0;
+   pending = done = false;
+   fwrite(&header, sizeof(header), 1, file);
+   filling.reserve(MSGLOG_BUFFER_RECORDS);
+   writing.reserve(MSGLOG_BUFFER_RECORDS);
+   writer = std::thread(&MsgLogWriter::writerLoop, this);
+}
+
+MsgLogWriter::~MsgLogWriter()
+{
+   close();
+}
+
+MsgLogWriter *MsgLogWriter::open(const char *fname, uint32_t unitSize, uint32_t processors, uint32_t protocol)
+{
+   FILE *f = fopen(fname, "wb");
+   if (f == 0)
+   {
+      printf("Message log file problem\n");
+      return NULL;
+   }
+   MsgLogHeader header = {MSGLOG_MAGIC, MSGLOG_VERSION, sizeof(MsgRecord), unitSize, processors, protocol};
+   return new MsgLogWriter(f, header);
+}
+
+/*background thread, writes out each buffer handed to it until the log is closed*/
+void MsgLogWriter::writerLoop()
+{
+   std::unique_lock<std::mutex> guard(lock);
+   while (true)
+   {
+      cond.wait(guard, [this] { return pending || done; });
+      if (!pending)
+         break; // Closed with nothing left to write
+      guard.unlock();
+      fwrite(writing.data(), sizeof(MsgRecord), writing.size(), file);
+      guard.lock();
+      writing.clear();
+      pending = false;
+      cond.notify_all();
+   }
+}
+
+/*swap the filled buffer with the written one, waits only if the writer is still behind*/
+void MsgLogWriter::handOff()
+{
+   std::unique_lock<std::mutex> guard(lock);
+   cond.wait(guard, [this] { return !pending; });
+   filling.swap(writing);
+   pending = true;
+   cond.notify_all();
+}
+
+void MsgLogWriter::log(uint64_t timestamp, uint8_t type, uint16_t src, uint16_t dst, uint64_t addr, uint16_t size)
+{
+   MsgRecord record = {timestamp, addr, src, dst, size, type, 0};
+   filling.push_back(record);
+   records++;
+   if (filling.size() == MSGLOG_BUFFER_RECORDS)
+      handOff();
+}
+
+/*flush what is buffered and stop the writer thread*/
+void MsgLogWriter::close()
+{
+   if (file == NULL)
+      return;
+   if (!filling.empty())
+      handOff();
+   {
+      std::unique_lock<std::mutex> guard(lock);
+      done = true;
+      cond.notify_all();
+   }
+   writer.join();
+   fclose(file);
+   file = NULL;
+}
+
+MsgLogReader::MsgLogReader()
+{
+   file = NULL;
+   next = count = 0;
+}
+
+MsgLogReader::~MsgLogReader()
+{
+   close();
+}
+
+/*returns false if fname is missing or not a message log of this version*/
+bool MsgLogReader::open(const char *fname)
+{
+   file = fopen(fname, "rb");
+   if (file == 0)
+      return false;
+   if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != MSGLOG_MAGIC ||
+       header.version != MSGLOG_VERSION || header.recordSize != sizeof(MsgRecord))
+   {
+      close();
+      return false;
+   }
+   buffer.resize(MSGLOG_BUFFER_RECORDS);
+   next = count = 0;
+   return true;
+}
+
+/*next record in log order, false at the end of the log*/
+bool MsgLogReader::read(MsgRecord &record)
+{
+   if (next == count)
+   {
+      if (file == NULL)
+         return false;
+      count = fread(buffer.data(), sizeof(MsgRecord), buffer.size(), file);
+      next = 0;
+      if (count == 0)
+         return false;
+   }
+   record = buffer[next++];
+   return true;
+}
+
+void MsgLogReader::close()
+{
+   if (file != NULL)
+      fclose(file);
+   file = NULL;
+}
@@ -0,0 +1,100 @@
+/*******************************************************
+                          msglog.h
+********************************************************/
+
+#ifndef MSGLOG_H
+#define MSGLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/****coherence messages a log record can hold****/
+enum
+{
+   MSG_GETS = 0,  // Read miss request, broadcast
+   MSG_GETM,      // Write miss (or exclusive read) request, broadcast
+   MSG_UPGRADE,   // GetM of a core that already holds the data
+   MSG_UPDATE,    // Write update of the adaptive mode, carries the data
+   MSG_INV,       // Invalidation of one remote copy
+   MSG_DATA,      // Data response from a cache, a write-back buffer or memory
+   MSG_WRITEBACK, // Dirty data on its way to memory
+   NUM_MSG_TYPES
+};
+
+#define MSG_MEMORY 0xFFFF    // src/dst of memory
+#define MSG_BROADCAST 0xFFFE // dst of a snooped request
+#define MSG_CONTROL_BYTES 8  // Size of a message without data
+
+#define MSGLOG_MAGIC 0x4C4D4343 // "CCML"
+#define MSGLOG_VERSION 1
+
+/*one message, 24 bytes on disk in host byte order. Every message of one bus
+transaction carries the same logical timestamp, the transaction's number*/
+struct MsgRecord
+{
+   uint64_t timestamp;
+   uint64_t addr; // Byte address of the block (or sector)
+   uint16_t src, dst;
+   uint16_t size; // Bytes on the interconnect
+   uint8_t type;  // MSG_*
+   uint8_t pad;
+};
+
+struct MsgLogHeader
+{
+   uint32_t magic, version;
+   uint32_t recordSize, unitSize, processors, protocol; // unitSize: block, or sector when sectored
+};
+
+/*buffered asynchronous writer: the simulator fills one buffer while a
+background thread writes the other one out*/
+class MsgLogWriter
+{
+protected:
+   FILE *file;
+   std::vector<MsgRecord> filling, writing;
+   std::thread writer;
+   std::mutex lock;
+   std::condition_variable cond;
+   bool pending, done;
+
+   void writerLoop();
+   void handOff();
+
+public:
+   uint64_t records;
+
+   MsgLogWriter(FILE *f, const MsgLogHeader &header);
+   ~MsgLogWriter();
+
+   static MsgLogWriter *open(const char *fname, uint32_t unitSize, uint32_t processors, uint32_t protocol);
+   void log(uint64_t timestamp, uint8_t type, uint16_t src, uint16_t dst, uint64_t addr, uint16_t size);
+   void close();
+};
+
+/*reader for replaying a log into an interconnect or DRAM model*/
+class MsgLogReader
+{
+protected:
+   FILE *file;
+   std::vector<MsgRecord> buffer;
+   size_t next, count;
+
+public:
+   MsgLogHeader header;
+
+   MsgLogReader();
+   ~MsgLogReader();
+
+   bool open(const char *fname);
+   bool read(MsgRecord &record);
+   void close();
+};
+
+const char *msgTypeName(unsigned int);
+
+#endif
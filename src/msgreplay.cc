@@ -0,0 +1,97 @@
+/*******************************************************
+					msgreplay.cc
+********************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include "msglog.h"
+using namespace std;
+
+/*core number, or mem / all for memory and a broadcast*/
+void printNode(unsigned int node)
+{
+	if (node == MSG_MEMORY)
+		printf("mem");
+	else if (node == MSG_BROADCAST)
+		printf("all");
+	else
+		printf("%u", node);
+}
+
+/*replays a message log written by smp_cache -msglog: the traffic per message
+type, per core and to memory, and the busiest bus transaction. An interconnect
+or DRAM model would take the records from the same MsgLogReader loop*/
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("input format: ./msgreplay <message_log> [-dump]\n");
+		exit(0);
+	}
+	bool dump = (argc > 2 && !strcmp(argv[2], "-dump"));
+
+	MsgLogReader reader;
+	if (!reader.open(argv[1]))
+	{
+		printf("Message log problem\n");
+		exit(0);
+	}
+	unsigned int procs = reader.header.processors;
+	printf("PROCESSORS: %u  PROTOCOL: %u  UNIT SIZE: %u\n", procs, reader.header.protocol, reader.header.unitSize);
+
+	unsigned long count[NUM_MSG_TYPES], bytes[NUM_MSG_TYPES];
+	memset(count, 0, sizeof(count));
+	memset(bytes, 0, sizeof(bytes));
+	map<unsigned int, unsigned long> sent, received; // Bytes per node, memory is MSG_MEMORY
+	unsigned long transactions = 0, lastTime = 0, busiestTime = 0, busiestBytes = 0, timeBytes = 0;
+
+	MsgRecord r;
+	while (reader.read(r))
+	{
+		if (dump)
+		{
+			printf("%lu %s ", (unsigned long)r.timestamp, msgTypeName(r.type));
+			printNode(r.src);
+			printf(" -> ");
+			printNode(r.dst);
+			printf(" 0x%lx %u\n", (unsigned long)r.addr, r.size);
+		}
+		if (r.type >= NUM_MSG_TYPES)
+			continue;
+		if (transactions == 0 || r.timestamp != lastTime)
+		{
+			transactions++;
+			lastTime = r.timestamp;
+			timeBytes = 0;
+		}
+		timeBytes += r.size;
+		if (timeBytes > busiestBytes)
+		{
+			busiestBytes = timeBytes;
+			busiestTime = r.timestamp;
+		}
+		count[r.type]++;
+		bytes[r.type] += r.size;
+		sent[r.src] += r.size;
+		if (r.dst == MSG_BROADCAST)
+		{
+			for (unsigned int p = 0; p < procs; p++)
+				if (p != r.src)
+					received[p] += r.size; // Every other cache snoops it
+		}
+		else
+			received[r.dst] += r.size;
+	}
+	reader.close();
+
+	printf("===== Messages =====\n");
+	for (unsigned int t = 0; t < NUM_MSG_TYPES; t++)
+		printf("%-10s messages: %lu  bytes: %lu\n", msgTypeName(t), count[t], bytes[t]);
+	printf("===== Traffic per node (bytes) =====\n");
+	for (unsigned int p = 0; p < procs; p++)
+		printf("Processor number : %u  sent: %lu  received: %lu\n", p, sent[p], received[p]);
+	printf("memory  reads: %lu  writes: %lu\n", sent[MSG_MEMORY], received[MSG_MEMORY]);
+	printf("bus transactions: %lu  busiest: %lu bytes at time %lu\n", transactions, busiestBytes, busiestTime);
+	return 0;
+}
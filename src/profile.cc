@@ -0,0 +1,105 @@
+/*******************************************************
+                          profile.cc
+********************************************************/
+
+#include "profile.h"
+
+#ifdef SIM_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+unsigned long phaseTicks[NUM_PHASES];
+
+static const char *phaseNames[NUM_PHASES] = {"parse", "access", "snoop", "stats", "print"};
+static std::chrono::steady_clock::time_point wallStart;
+static unsigned long ticksStart;
+static bool perfRequested;
+
+#ifdef __linux__
+#define NUM_PERF_COUNTERS 4
+static const char *perfNames[NUM_PERF_COUNTERS] = {"cycles", "instructions", "LLC misses", "branch misses"};
+static const unsigned long perfConfigs[NUM_PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                             PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+static int perfFds[NUM_PERF_COUNTERS] = {-1, -1, -1, -1};
+
+/*user space hardware counter for this process, -1 if the kernel refuses it*/
+static int openPerfCounter(unsigned long config)
+{
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = PERF_TYPE_HARDWARE;
+   attr.config = config;
+   attr.disabled = 1;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void profileBegin(bool perfCounters)
+{
+   memset(phaseTicks, 0, sizeof(phaseTicks));
+   perfRequested = perfCounters;
+#ifdef __linux__
+   for (int i = 0; perfCounters && i < NUM_PERF_COUNTERS; i++)
+   {
+      perfFds[i] = openPerfCounter(perfConfigs[i]);
+      if (perfFds[i] != -1)
+         ioctl(perfFds[i], PERF_EVENT_IOC_ENABLE, 0);
+   }
+#else
+   if (perfCounters)
+      printf("perf counters are only supported on linux\n");
+#endif
+   wallStart = std::chrono::steady_clock::now();
+   ticksStart = PROFILE_TICKS();
+}
+
+void profileEnd(unsigned long accesses)
+{
+   unsigned long ticks = PROFILE_TICKS() - ticksStart;
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+   double ticksPerSecond = (seconds > 0) ? ticks / seconds : 0;
+
+   printf("===== Simulator profile =====\n");
+   printf("wall time: %.6f s  simulated accesses/sec: %.0f\n", seconds, (seconds > 0) ? accesses / seconds : 0.0);
+   unsigned long attributed = 0;
+   for (int p = 0; p < NUM_PHASES; p++)
+   {
+      attributed += phaseTicks[p];
+      printf("%-8s %6.2f%%  %.6f s\n", phaseNames[p], (ticks != 0) ? 100.0 * phaseTicks[p] / ticks : 0.0,
+             (ticksPerSecond > 0) ? phaseTicks[p] / ticksPerSecond : 0.0);
+   }
+   unsigned long other = (ticks > attributed) ? ticks - attributed : 0;
+   printf("%-8s %6.2f%%  %.6f s\n", "other", (ticks != 0) ? 100.0 * other / ticks : 0.0,
+          (ticksPerSecond > 0) ? other / ticksPerSecond : 0.0);
+
+#ifdef __linux__
+   bool opened = false;
+   for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+   {
+      if (perfFds[i] == -1)
+         continue;
+      opened = true;
+      unsigned long long value = 0;
+      ioctl(perfFds[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(perfFds[i], &value, sizeof(value)) == (ssize_t)sizeof(value))
+         printf("%-14s %llu (%.2f per access)\n", perfNames[i], value, (accesses != 0) ? (double)value / accesses : 0.0);
+      close(perfFds[i]);
+      perfFds[i] = -1;
+   }
+   if (perfRequested && !opened)
+      printf("perf counters unavailable (perf_event_open refused, check perf_event_paranoid)\n");
+#endif
+}
+
+#endif
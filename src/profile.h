@@ -0,0 +1,65 @@
+/*******************************************************
+                          profile.h
+********************************************************/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/****phases of the trace loop the simulator's own time is split in****/
+enum
+{
+   PHASE_PARSE = 0, // Trace parsing and run detection
+   PHASE_ACCESS,    // Access and the local hit fast path in the requesting cache
+   PHASE_SNOOP,     // busResponse on every other cache plus sendBusReaction
+   PHASE_STATS,     // updateStats and the running totals
+   PHASE_PRINT,     // State dumps and reports
+   NUM_PHASES
+};
+
+/*built with make PROFILE=1 only, otherwise every macro below expands to nothing*/
+#ifdef SIM_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TICKS() ((unsigned long)__rdtsc())
+#else
+#include <chrono>
+#define PROFILE_TICKS() ((unsigned long)std::chrono::steady_clock::now().time_since_epoch().count())
+#endif
+
+extern unsigned long phaseTicks[NUM_PHASES];
+
+/*adds the ticks spent in its scope to a phase*/
+class PhaseTimer
+{
+protected:
+   int phase;
+   unsigned long start;
+
+public:
+   PhaseTimer(int p)
+   {
+      phase = p;
+      start = PROFILE_TICKS();
+   }
+   ~PhaseTimer() { phaseTicks[phase] += PROFILE_TICKS() - start; }
+};
+
+void profileBegin(bool perfCounters);
+void profileEnd(unsigned long accesses);
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_PHASE(p) PhaseTimer PROFILE_CONCAT(phaseTimer, __LINE__)(p)
+#define PROFILE_BEGIN(perfCounters) profileBegin(perfCounters)
+#define PROFILE_END(accesses) profileEnd(accesses)
+
+#else
+
+#define PROFILE_PHASE(p)
+#define PROFILE_BEGIN(perfCounters)
+#define PROFILE_END(accesses)
+
+#endif
+
+#endif
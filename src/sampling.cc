@@ -0,0 +1,89 @@
+/*******************************************************
+                          sampling.cc
+********************************************************/
+
+#include <stdio.h>
+#include <cmath>
+#include "sampling.h"
+
+const char *sampleMetricName(uint metric)
+{
+   switch (metric)
+   {
+   case SAMPLE_READS:
+      return "reads";
+   case SAMPLE_WRITES:
+      return "writes";
+   case SAMPLE_READ_MISSES:
+      return "read misses";
+   case SAMPLE_WRITE_MISSES:
+      return "write misses";
+   case SAMPLE_WRITEBACKS:
+      return "writebacks";
+   case SAMPLE_INVALIDATIONS:
+      return "invalidations";
+   case SAMPLE_GETM:
+      return "getMMsgs";
+   case SAMPLE_GETS:
+      return "getSMsgs";
+   case SAMPLE_FROM_OTHER_CORE:
+      return "servicedFromOtherCore";
+   case SAMPLE_FROM_MEM:
+      return "servicedFromMem";
+   }
+   return "?";
+}
+
+SetSampler::SetSampler(ulong s, ulong r)
+{
+   sets = s;
+   rate = r;
+   dropped = 0;
+   sampledSets = 0;
+   for (ulong i = 0; i < sets; i++)
+      if (sampleSet(i))
+         sampledSets++;
+   if (sampledSets == 0)
+      sampledSets = 1; // Degenerate tiny cache, nothing is simulated
+}
+
+/*parse time filter, false drops the access before it reaches Access*/
+bool SetSampler::isSampled(ulong block)
+{
+   if (sampleSet(block & (sets - 1)))
+      return true;
+   dropped++;
+   return false;
+}
+
+void SetSampler::account(ulong block, ulong *delta)
+{
+   std::vector<ulong> &counts = perSet[block & (sets - 1)];
+   if (counts.empty())
+      counts.resize(NUM_SAMPLE_METRICS, 0);
+   for (uint m = 0; m < NUM_SAMPLE_METRICS; m++)
+      counts[m] += delta[m];
+}
+
+/*totals are N * mean over the n sampled sets, their standard error is
+N * sqrt((1 - n/N) * s^2 / n) with s^2 the variance of the per set counts*/
+void SetSampler::print()
+{
+   double n = (double)sampledSets, N = (double)sets;
+   printf("===== Set sampling (1 in %lu sets) =====\n", rate);
+   printf("sampled sets: %lu of %lu  dropped accesses: %lu  scale: %.3f\n", sampledSets, sets, dropped, getScale());
+   for (uint m = 0; m < NUM_SAMPLE_METRICS; m++)
+   {
+      double sum = 0, sumSquares = 0;
+      for (std::unordered_map<ulong, std::vector<ulong> >::iterator it = perSet.begin(); it != perSet.end(); ++it)
+      {
+         double x = (double)it->second[m];
+         sum += x;
+         sumSquares += x * x;
+      }
+      double variance = (n > 1) ? (sumSquares - sum * sum / n) / (n - 1) : 0;
+      double estimate = N * sum / n;
+      double error = N * sqrt((1 - n / N) * variance / n);
+      printf("%-22s %12.0f +- %-10.0f (%.1f%%)\n", sampleMetricName(m), estimate, error, (estimate > 0) ? 100 * error / estimate : 0.0);
+   }
+}
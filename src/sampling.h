@@ -0,0 +1,52 @@
+/*******************************************************
+                          sampling.h
+********************************************************/
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <vector>
+#include <unordered_map>
+
+typedef unsigned long ulong;
+typedef unsigned int uint;
+
+/****counters whose totals are extrapolated from the sampled sets****/
+enum
+{
+   SAMPLE_READS = 0,
+   SAMPLE_WRITES,
+   SAMPLE_READ_MISSES,
+   SAMPLE_WRITE_MISSES,
+   SAMPLE_WRITEBACKS,
+   SAMPLE_INVALIDATIONS,
+   SAMPLE_GETM,
+   SAMPLE_GETS,
+   SAMPLE_FROM_OTHER_CORE,
+   SAMPLE_FROM_MEM,
+   NUM_SAMPLE_METRICS
+};
+
+/*set sampling: only blocks of one set in every rate sets (picked by a hash of
+the set index, the same sets in every cache) are simulated. Counter deltas are
+kept per sampled set so the extrapolated totals come with a standard error*/
+class SetSampler
+{
+protected:
+   ulong sets, rate, sampledSets, dropped;
+   std::unordered_map<ulong, std::vector<ulong> > perSet; // Sampled sets that saw accesses
+
+   bool sampleSet(ulong set) { return ((set * 0x9E3779B97F4A7C15UL) >> 32) % rate == 0; }
+
+public:
+   SetSampler(ulong sets, ulong rate);
+
+   bool isSampled(ulong block);
+   void account(ulong block, ulong *delta);
+   double getScale() { return (double)sets / (double)sampledSets; }
+   void print();
+};
+
+const char *sampleMetricName(uint);
+
+#endif
@@ -0,0 +1,110 @@
+/*******************************************************
+                          setstore.cc
+********************************************************/
+
+#include "cache.h"
+#include "setstore.h"
+
+#define EMPTY_SET (~0UL)
+#define CHUNK_BYTES 4096
+#define INITIAL_SLOTS_LOG2 6
+#define INITIAL_SLOTS (1UL << INITIAL_SLOTS_LOG2)
+
+SetStore::SetStore(ulong a)
+{
+   assoc = a;
+   setsPerChunk = CHUNK_BYTES / (assoc * sizeof(cacheLine));
+   if (setsPerChunk == 0)
+      setsPerChunk = 1; // Sets larger than a page get a chunk of their own
+   chunk = NULL;
+   chunkUsed = setsPerChunk;
+
+   capacity = INITIAL_SLOTS;
+   mask = capacity - 1;
+   shift = 64 - INITIAL_SLOTS_LOG2;
+   used = 0;
+   keys = new ulong[capacity];
+   vals = new cacheLine *[capacity];
+   for (ulong i = 0; i < capacity; i++)
+      keys[i] = EMPTY_SET;
+}
+
+SetStore::~SetStore()
+{
+   for (ulong i = 0; i < chunks.size(); i++)
+      delete[] chunks[i];
+   delete[] keys;
+   delete[] vals;
+}
+
+/*return the lines of a set, NULL if nothing was ever allocated in it*/
+cacheLine *SetStore::find(ulong set)
+{
+   for (ulong i = slotOf(set);; i = (i + 1) & mask)
+   {
+      if (keys[i] == set)
+         return vals[i];
+      if (keys[i] == EMPTY_SET)
+         return NULL;
+   }
+}
+
+/*return the lines of a set, materializing it (all lines invalid) on first touch*/
+cacheLine *SetStore::touch(ulong set)
+{
+   ulong i;
+   for (i = slotOf(set); keys[i] != EMPTY_SET; i = (i + 1) & mask)
+   {
+      if (keys[i] == set)
+         return vals[i];
+   }
+
+   if (chunkUsed == setsPerChunk)
+   {
+      chunk = new cacheLine[setsPerChunk * assoc];
+      chunks.push_back(chunk);
+      chunkUsed = 0;
+   }
+   cacheLine *lines = &chunk[chunkUsed * assoc];
+   chunkUsed++;
+
+   keys[i] = set;
+   vals[i] = lines;
+   used++;
+   if (2 * used > capacity)
+      grow(); // Keep the load factor at or below one half
+   return lines;
+}
+
+void SetStore::grow()
+{
+   ulong oldCapacity = capacity;
+   ulong *oldKeys = keys;
+   cacheLine **oldVals = vals;
+
+   capacity *= 2;
+   mask = capacity - 1;
+   shift--;
+   keys = new ulong[capacity];
+   vals = new cacheLine *[capacity];
+   for (ulong i = 0; i < capacity; i++)
+      keys[i] = EMPTY_SET;
+   for (ulong i = 0; i < oldCapacity; i++)
+   {
+      if (oldKeys[i] == EMPTY_SET)
+         continue;
+      ulong j = slotOf(oldKeys[i]);
+      while (keys[j] != EMPTY_SET)
+         j = (j + 1) & mask;
+      keys[j] = oldKeys[i];
+      vals[j] = oldVals[i];
+   }
+   delete[] oldKeys;
+   delete[] oldVals;
+}
+
+/*memory held by the chunks and the index*/
+ulong SetStore::getBytes()
+{
+   return chunks.size() * setsPerChunk * assoc * sizeof(cacheLine) + capacity * (sizeof(ulong) + sizeof(cacheLine *));
+}
@@ -0,0 +1,41 @@
+/*******************************************************
+                          setstore.h
+********************************************************/
+
+#ifndef SETSTORE_H
+#define SETSTORE_H
+
+#include <vector>
+
+typedef unsigned long ulong;
+
+class cacheLine;
+
+/*sparse storage for the sets of a cache: a set is only materialized the first
+time a line is allocated in it. Sets are carved out of page sized chunks and
+found through an open addressing (linear probing) index keyed by set number*/
+class SetStore
+{
+protected:
+   ulong assoc, setsPerChunk, chunkUsed;
+   cacheLine *chunk; // Chunk new sets are carved from
+   std::vector<cacheLine *> chunks;
+
+   ulong *keys; // Set number per slot, EMPTY_SET when free
+   cacheLine **vals;
+   ulong capacity, used, mask, shift; // shift: 64 - log2(capacity)
+
+   ulong slotOf(ulong set) { return (set * 0x9E3779B97F4A7C15UL) >> shift; } // Fibonacci hashing, the high bits are the well mixed ones
+   void grow();
+
+public:
+   SetStore(ulong assoc);
+   ~SetStore();
+
+   cacheLine *find(ulong set);
+   cacheLine *touch(ulong set);
+   ulong getSets() { return used; }
+   ulong getBytes();
+};
+
+#endif
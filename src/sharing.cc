@@ -0,0 +1,118 @@
+/*******************************************************
+                          sharing.cc
+********************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "sharing.h"
+
+const char *sharingPatternName(uint pattern)
+{
+   switch (pattern)
+   {
+   case SHARING_NONE:
+      return "none";
+   case SHARING_MIGRATORY:
+      return "migratory";
+   case SHARING_PRODUCER_CONSUMER:
+      return "producer-consumer";
+   case SHARING_READ_MOSTLY:
+      return "read-mostly";
+   }
+   return "?";
+}
+
+SharingPredictor::SharingPredictor()
+{
+   table.resize(PREDICTOR_ENTRIES);
+   for (ulong i = 0; i < PREDICTOR_ENTRIES; i++)
+      table[i].valid = false;
+   memset(evidence, 0, sizeof(evidence));
+   memset(hints, 0, sizeof(hints));
+   conflicts = 0;
+}
+
+/*entry of block, a block that does not own its slot takes it over with no history*/
+SharingEntry &SharingPredictor::entryOf(ulong block)
+{
+   SharingEntry &e = table[block % PREDICTOR_ENTRIES];
+   if (!e.valid || e.block != block)
+   {
+      if (e.valid)
+         conflicts++;
+      e.block = block;
+      e.valid = true;
+      e.lastWriter = NO_WRITER;
+      e.readers = 0;
+      memset(e.confidence, 0, sizeof(e.confidence));
+   }
+   return e;
+}
+
+void SharingPredictor::train(SharingEntry &e, uint pattern, bool seen)
+{
+   if (seen)
+   {
+      evidence[pattern]++;
+      if (e.confidence[pattern] < CONFIDENCE_MAX)
+         e.confidence[pattern]++;
+   }
+   else if (e.confidence[pattern] > 0)
+      e.confidence[pattern]--;
+}
+
+/*migratory wins over the others because its reads are followed by writes of the same core*/
+uint SharingPredictor::patternOf(SharingEntry &e)
+{
+   if (e.confidence[SHARING_MIGRATORY] >= CONFIDENCE_THRESHOLD)
+      return SHARING_MIGRATORY;
+   if (e.confidence[SHARING_PRODUCER_CONSUMER] >= CONFIDENCE_THRESHOLD)
+      return SHARING_PRODUCER_CONSUMER;
+   if (e.confidence[SHARING_READ_MOSTLY] >= CONFIDENCE_THRESHOLD)
+      return SHARING_READ_MOSTLY;
+   return SHARING_NONE;
+}
+
+/*pattern the next access of block should be optimized for*/
+uint SharingPredictor::predict(ulong block)
+{
+   SharingEntry &e = table[block % PREDICTOR_ENTRIES];
+   uint pattern = (e.valid && e.block == block) ? patternOf(e) : SHARING_NONE;
+   hints[pattern]++;
+   return pattern;
+}
+
+void SharingPredictor::observe(ulong block, int proc, bool write)
+{
+   SharingEntry &e = entryOf(block);
+   ulong self = 1UL << (proc % 64);
+   if (!write)
+   {
+      e.readers |= self;
+      return;
+   }
+   ulong others = e.readers & ~self;
+   if (others != 0 || (e.lastWriter != NO_WRITER && e.lastWriter != proc))
+   {
+      // Rewrites by the last writer with no remote read in between teach nothing
+      train(e, SHARING_MIGRATORY, e.lastWriter != NO_WRITER && e.lastWriter != proc && e.readers == self);
+      train(e, SHARING_PRODUCER_CONSUMER, e.lastWriter == proc && others != 0);
+      train(e, SHARING_READ_MOSTLY, __builtin_popcountl(others) >= 2);
+   }
+   e.lastWriter = proc;
+   e.readers = 0;
+}
+
+void SharingPredictor::print()
+{
+   ulong blocks[NUM_SHARING_PATTERNS];
+   memset(blocks, 0, sizeof(blocks));
+   for (ulong i = 0; i < PREDICTOR_ENTRIES; i++)
+      if (table[i].valid)
+         blocks[patternOf(table[i])]++;
+
+   printf("===== Sharing predictor (%d entries) =====\n", PREDICTOR_ENTRIES);
+   for (uint p = SHARING_MIGRATORY; p < NUM_SHARING_PATTERNS; p++)
+      printf("%-18s evidence: %lu  predicted accesses: %lu  blocks at end: %lu\n", sharingPatternName(p), evidence[p], hints[p], blocks[p]);
+   printf("predictor conflicts: %lu\n", conflicts);
+}
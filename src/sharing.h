@@ -0,0 +1,63 @@
+/*******************************************************
+                          sharing.h
+********************************************************/
+
+#ifndef SHARING_H
+#define SHARING_H
+
+#include <vector>
+
+typedef unsigned long ulong;
+typedef unsigned char uchar;
+typedef unsigned int uint;
+
+/****sharing patterns the adaptive mode predicts per block****/
+enum
+{
+   SHARING_NONE = 0,
+   SHARING_MIGRATORY,         // Read then written by one core after the other
+   SHARING_PRODUCER_CONSUMER, // Written by one core, read by others in between
+   SHARING_READ_MOSTLY,       // Several readers between two writes
+   NUM_SHARING_PATTERNS
+};
+
+#define PREDICTOR_ENTRIES 4096 // Direct mapped, indexed by block number
+#define CONFIDENCE_MAX 3       // 2 bit saturating counters
+#define CONFIDENCE_THRESHOLD 2
+#define NO_WRITER (-1)
+
+struct SharingEntry
+{
+   ulong block;
+   bool valid;
+   int lastWriter;
+   ulong readers; // Cores that read the block since its last write, bit proc % 64
+   uchar confidence[NUM_SHARING_PATTERNS];
+};
+
+/*per block sharing pattern predictor. It is trained on the accesses of the trace,
+not on the bus traffic, so the hints it gives cannot feed back into what it learns.
+Evidence is taken at writes, from who wrote last and who read since then*/
+class SharingPredictor
+{
+protected:
+   std::vector<SharingEntry> table;
+   ulong evidence[NUM_SHARING_PATTERNS]; // Writes that showed the pattern
+   ulong hints[NUM_SHARING_PATTERNS];    // Accesses that were predicted as the pattern
+   ulong conflicts;                      // Entries taken over by another block
+
+   SharingEntry &entryOf(ulong block);
+   void train(SharingEntry &e, uint pattern, bool seen);
+   uint patternOf(SharingEntry &e);
+
+public:
+   SharingPredictor();
+
+   uint predict(ulong block);
+   void observe(ulong block, int proc, bool write);
+   void print();
+};
+
+const char *sharingPatternName(uint);
+
+#endif
@@ -0,0 +1,107 @@
+/*******************************************************
+                          storebuf.cc
+********************************************************/
+
+#include "storebuf.h"
+
+StoreBuffer::StoreBuffer(int p, ulong d, StorePerformer f)
+{
+   proc = p;
+   depth = d;
+   perform = f;
+   busyUntil = 0;
+   stores = coalesced = forwarded = drained = fullStalls = stallCycles = drainCycles = 0;
+}
+
+/*perform the oldest store, it starts once the previous one completed, returns its completion cycle*/
+ulong StoreBuffer::drainOne()
+{
+   ulong addr = fifo.front().addrs[0];
+   ulong start = (busyUntil > fifo.front().readyAt) ? busyUntil : fifo.front().readyAt;
+   fifo.pop_front();
+   ulong latency = perform(proc, addr);
+   busyUntil = start + latency;
+   drained++;
+   drainCycles += latency;
+   return busyUntil;
+}
+
+/*store to load forwarding, a load of an address with a buffered store is served by the buffer.
+Trace records carry no access size, so only a load of the exact address a store wrote forwards*/
+bool StoreBuffer::forward(ulong addr)
+{
+   for (std::deque<StoreEntry>::reverse_iterator it = fifo.rbegin(); it != fifo.rend(); ++it)
+   {
+      for (ulong i = 0; i < it->addrs.size(); i++)
+      {
+         if (it->addrs[i] == addr)
+         {
+            forwarded++;
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+/*retire a store into the buffer, returns the cycles the core stalls because the buffer is full*/
+ulong StoreBuffer::insert(ulong addr, ulong block, ulong now)
+{
+   stores++;
+   drainUntil(now);
+   if (!fifo.empty() && fifo.back().block == block)
+   {
+      coalesced++; // Shares the GetM of the youngest buffered store
+      std::vector<ulong> &addrs = fifo.back().addrs;
+      for (ulong i = 0; i < addrs.size(); i++)
+         if (addrs[i] == addr)
+            return 0;
+      addrs.push_back(addr);
+      return 0;
+   }
+
+   ulong stall = 0;
+   if (fifo.size() == depth)
+   {
+      ulong done = drainOne();
+      fullStalls++;
+      if (done > now)
+         stall = done - now;
+      stallCycles += stall;
+   }
+   StoreEntry entry;
+   entry.block = block;
+   entry.readyAt = now + stall;
+   entry.addrs.push_back(addr);
+   fifo.push_back(entry);
+   return stall;
+}
+
+/*background drain: perform every store whose turn comes up by cycle now*/
+void StoreBuffer::drainUntil(ulong now)
+{
+   while (!fifo.empty())
+   {
+      ulong start = (busyUntil > fifo.front().readyAt) ? busyUntil : fifo.front().readyAt;
+      if (start > now)
+         break;
+      drainOne();
+   }
+}
+
+/*fence: perform every buffered store, returns the cycles the core waits for them*/
+ulong StoreBuffer::drainAll(ulong now)
+{
+   while (!fifo.empty())
+      drainOne();
+   ulong stall = (busyUntil > now) ? busyUntil - now : 0;
+   stallCycles += stall;
+   return stall;
+}
+
+/*end of trace: perform what is left without charging the core*/
+void StoreBuffer::flush()
+{
+   while (!fifo.empty())
+      drainOne();
+}
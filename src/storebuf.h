@@ -0,0 +1,55 @@
+/*******************************************************
+                          storebuf.h
+********************************************************/
+
+#ifndef STOREBUF_H
+#define STOREBUF_H
+
+#include <deque>
+#include <vector>
+
+typedef unsigned long ulong;
+
+/****memory consistency models a core with a store buffer can follow****/
+enum
+{
+   MODEL_SC = 0, // Loads wait until every older store has drained
+   MODEL_TSO     // Loads bypass older stores, forwarding from the buffer
+};
+
+/*performs a buffered store through the coherence protocol and returns its latency in cycles*/
+typedef ulong (*StorePerformer)(int proc, ulong addr);
+
+struct StoreEntry
+{
+   ulong block, readyAt;      // readyAt: cycle the store entered the buffer
+   std::vector<ulong> addrs; // Addresses of the coalesced stores, the first one is performed
+};
+
+/*per core FIFO of retired stores that have not been performed in the caches yet.
+A store to the same block as the youngest entry coalesces with it, which keeps
+stores in program order as TSO requires*/
+class StoreBuffer
+{
+protected:
+   int proc;
+   ulong depth, busyUntil; // busyUntil: cycle the store being drained completes
+   std::deque<StoreEntry> fifo;
+   StorePerformer perform;
+
+   ulong drainOne();
+
+public:
+   ulong stores, coalesced, forwarded, drained, fullStalls, stallCycles, drainCycles;
+
+   StoreBuffer(int proc, ulong depth, StorePerformer perform);
+
+   bool forward(ulong addr);
+   ulong insert(ulong addr, ulong block, ulong now);
+   void drainUntil(ulong now);
+   ulong drainAll(ulong now);
+   void flush();
+   bool isEmpty() { return fifo.empty(); }
+};
+
+#endif
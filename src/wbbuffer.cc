@@ -0,0 +1,74 @@
+/*******************************************************
+                          wbbuffer.cc
+********************************************************/
+
+#include "wbbuffer.h"
+
+WritebackBuffer::WritebackBuffer(ulong d)
+{
+   depth = d;
+   now = 0;
+   writebacks = coalesced = written = supplied = fullStalls = stallCycles = 0;
+}
+
+/*retire every writeback memory has completed by clock*/
+void WritebackBuffer::advance(ulong clock)
+{
+   if (clock > now)
+      now = clock;
+   while (!fifo.empty() && fifo.front().doneAt <= now)
+   {
+      fifo.pop_front();
+      written++;
+   }
+}
+
+/*queue the writeback of block, returns the cycles its cache stalls because the buffer is full*/
+ulong WritebackBuffer::push(ulong block, ulong clock)
+{
+   writebacks++;
+   advance(clock);
+   for (std::deque<WritebackEntry>::iterator it = fifo.begin(); it != fifo.end(); ++it)
+   {
+      if (it->block == block)
+      {
+         coalesced++; // The newer data rides on the pending memory write
+         return 0;
+      }
+   }
+
+   ulong stall = 0;
+   if (fifo.size() == depth)
+   {
+      fullStalls++;
+      stall = fifo.front().doneAt - now;
+      stallCycles += stall;
+      advance(fifo.front().doneAt);
+   }
+   ulong start = fifo.empty() ? now : fifo.back().doneAt;
+   WritebackEntry entry = {block, start + WB_DRAIN_LATENCY};
+   fifo.push_back(entry);
+   return stall;
+}
+
+/*end of run, memory completes every writeback still buffered*/
+void WritebackBuffer::drain()
+{
+   written += fifo.size();
+   fifo.clear();
+}
+
+/*a miss to a block whose writeback is still pending gets the data from the buffer*/
+bool WritebackBuffer::supply(ulong block, ulong clock)
+{
+   advance(clock);
+   for (std::deque<WritebackEntry>::iterator it = fifo.begin(); it != fifo.end(); ++it)
+   {
+      if (it->block == block)
+      {
+         supplied++;
+         return true;
+      }
+   }
+   return false;
+}
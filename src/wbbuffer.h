@@ -0,0 +1,40 @@
+/*******************************************************
+                          wbbuffer.h
+********************************************************/
+
+#ifndef WBBUFFER_H
+#define WBBUFFER_H
+
+#include <deque>
+
+typedef unsigned long ulong;
+
+#define WB_DRAIN_LATENCY 100 // Cycles memory takes for one buffered writeback, MEM_LATENCY
+
+struct WritebackEntry
+{
+   ulong block, doneAt; // block: block number, or sector number with -sectors. doneAt: cycle its memory write completes
+};
+
+/*per core FIFO of dirty blocks on their way to memory. Memory takes one at a
+time, a writeback of a block that is still buffered coalesces with it, and a
+miss to a buffered block is served from the buffer instead of memory*/
+class WritebackBuffer
+{
+protected:
+   ulong depth, now; // now: latest bus cycle the buffer has seen
+   std::deque<WritebackEntry> fifo;
+
+   void advance(ulong clock);
+
+public:
+   ulong writebacks, coalesced, written, supplied, fullStalls, stallCycles;
+
+   WritebackBuffer(ulong depth);
+
+   ulong push(ulong block, ulong clock);
+   bool supply(ulong block, ulong clock);
+   void drain();
+};
+
+#endif